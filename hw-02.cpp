@@ -59,37 +59,26 @@ int main() {
 
 	} while (b != 0);
 
-	std::vector<Integer*> values;
-	Integer* a_ptr = nullptr;
+	// The values are stored by value (not as pointers to new Integers), so
+	// they sit next to each other in memory and are freed automatically.
+	// Each one is a SignedInteger, and so is printed with its sign.
+	std::vector<SignedInteger> values;
 
 	std::cout << "Enter some more integers! (0 to end): ";
 	std::cin >> a;
 
 	while (a != 0) {
-		if (a < 0) {
-
-			a_ptr = new SignedInteger(a);
-
-		}
-		else {
-
-			a_ptr = new Integer(a);
-
-		}
-
-		values.push_back(a_ptr);
+		values.push_back(SignedInteger(a));
 
 		std::cout << "Enter some more integers! (0 to end): ";
 		std::cin >> a;
 	}
 
-	a_ptr = nullptr;
-
 	int num_entries = values.size();
 
 	std::cout << std::endl << "The values you entered (in decimal) were: " << std::endl;
 	for (int i = 0; i < num_entries; ++i) {
-		std::cout << values[i]->decimal_string();
+		std::cout << values[i].decimal_string();
 
 		if (i < num_entries - 1) {
 			std::cout << ", ";
@@ -99,7 +88,7 @@ int main() {
 	std::cout << std::endl << "The values you entered (in binary) were: " << std::endl;
 
 	for (int i = 0; i < num_entries; ++i) {
-		std::cout << values[i]->binary_string();
+		std::cout << values[i].binary_string();
 
 		if (i < num_entries - 1) {
 			std::cout << ", ";
@@ -117,13 +106,13 @@ int main() {
 
 	for (int i = 0; i < num_entries; ++i) {
 		for (int j = 0; j < num_inc; ++j) {
-			++(*values[i]);
+			++values[i];
 		}
 	}
 
 	std::cout << std::endl << "The incremented values are: " << std::endl;
 	for (int i = 0; i < num_entries; ++i) {
-		std::cout << values[i]->decimal_string();
+		std::cout << values[i].decimal_string();
 
 		if (i < num_entries - 1) {
 			std::cout << ", ";
@@ -0,0 +1,206 @@
+////////////////////////////////////////////////////////////////////////////////
+// @file hw-03-alloc.cpp
+// @mainpage
+//
+// Description: counts the memory allocations of chained Integer and
+// SignedInteger expressions, by replacing the global operator new. Each
+// binary operator copies its left operand once (or computes in the storage
+// of an expiring operand), so a chain such as a + b + c + d allocates once,
+// as long as no later operand is longer than the running result. Moves and
+// compound assignments within the capacity of their target allocate
+// nothing. Build it once for each storage option of Integer:
+//   cp integer_3.h integer.h
+//   g++ -std=c++17 -O2 -pthread integer_3.cpp hw-03-alloc.cpp
+//   g++ -std=c++17 -O2 -pthread -DINTEGER_COPY_ON_WRITE integer_3.cpp hw-03-alloc.cpp
+//   g++ -std=c++17 -O2 -pthread -DINTEGER_USE_PMR integer_3.cpp hw-03-alloc.cpp
+// The program prints the count for each expression and exits with status 1
+// if any count is above its bound.
+//
+// Known bugs: None so far!
+////////////////////////////////////////////////////////////////////////////////
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstdlib>
+#include <new>
+#include "integer.h"
+
+// The number of calls to operator new so far
+static long num_allocations = 0;
+
+// Allocate memory for operator new, counting the call.
+// @param size the number of bytes
+// @return the memory
+void* counted_allocation(std::size_t size);
+
+void* operator new(std::size_t size) {
+	return counted_allocation(size);
+}
+
+void* operator new[](std::size_t size) {
+	return counted_allocation(size);
+}
+
+void operator delete(void* ptr) noexcept {
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept {
+	std::free(ptr);
+}
+
+#if __cplusplus >= 201703L
+
+// std::pmr::new_delete_resource, behind INTEGER_USE_PMR, allocates through
+// the aligned forms.
+void* operator new(std::size_t size, std::align_val_t) {
+	return counted_allocation(size);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept {
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept {
+	std::free(ptr);
+}
+
+#endif
+
+// With INTEGER_COPY_ON_WRITE a copy shares the bits, and they are cloned
+// (a reference-counted block and its vector) when the copy is modified.
+#ifdef INTEGER_COPY_ON_WRITE
+static const long allocations_per_copy = 2;
+#else
+static const long allocations_per_copy = 1;
+#endif
+
+// Count the allocations made by f, and compare them with a bound.
+// @param expression the expression f evaluates, for printing
+// @param f the function to run
+// @param bound the largest allowed number of allocations
+// @return true if the count was within the bound
+template <typename Function>
+bool check_allocations(const std::string& expression, Function f, long bound);
+
+// Build an Integer of exactly num_bits bits.
+Integer make_integer(int num_bits);
+
+int main() {
+
+	Integer a = make_integer(1000);
+	Integer b = make_integer(900);
+	Integer c = make_integer(999);
+	Integer d = make_integer(500);
+
+	SignedInteger sa(a), sb(b), sc(c);
+	sb.negate();
+
+	// Results are assigned to variables that already hold long values, so
+	// only the temporaries of each expression are counted.
+	Integer r = a + a;
+	SignedInteger sr = sa + sa;
+
+	// The first uses of the library set up thread-local state; do them
+	// before counting.
+	r = a * b;
+	sr = sa * sb;
+
+	bool ok = true;
+	const long once = allocations_per_copy;
+
+	std::cout << "Chains of operators copy their first operand once:" << std::endl;
+	ok = check_allocations("r = a + b", [&]() { r = a + b; }, once) && ok;
+	ok = check_allocations("r = a + b + c + d", [&]() { r = a + b + c + d; }, once) && ok;
+	ok = check_allocations("r = a - b - d", [&]() { r = a - b - d; }, once) && ok;
+	ok = check_allocations("r = (a & b) | c", [&]() { r = (a & b) | c; }, once) && ok;
+	ok = check_allocations("r = a ^ b ^ c ^ d", [&]() { r = a ^ b ^ c ^ d; }, once) && ok;
+	ok = check_allocations("r = a + (c + d)", [&]() { r = a + (c + d); }, once) && ok;
+	ok = check_allocations("sr = sa + sb - sc", [&]() { sr = sa + sb - sc; }, once) && ok;
+	ok = check_allocations("sr = sa - (sc + sb)", [&]() { sr = sa - (sc + sb); }, once) && ok;
+
+	std::cout << std::endl << "A later, longer operand regrows the result once:" << std::endl;
+	ok = check_allocations("r = d + b + a", [&]() { r = d + b + a; }, 2 * once) && ok;
+
+	std::cout << std::endl << "Expiring operands and moves allocate nothing:" << std::endl;
+	ok = check_allocations("r = std::move(r) + a + b", [&]() {
+		r = std::move(r) + a + b;
+	}, 0) && ok;
+	ok = check_allocations("r = std::move(r) - a - b", [&]() {
+		r = std::move(r) - a - b;
+	}, 0) && ok;
+	ok = check_allocations("r += a; r -= b", [&]() {
+		r += a;
+		r -= b;
+	}, 0) && ok;
+	ok = check_allocations("sr += sb; sr -= sc", [&]() {
+		sr += sb;
+		sr -= sc;
+	}, 0) && ok;
+
+	Integer t = a;
+	ok = check_allocations("Integer u(std::move(t)); t = std::move(u)", [&]() {
+		Integer u(std::move(t));
+		t = std::move(u);
+	}, 0) && ok;
+	ok = check_allocations("r.set_value(std::move(t))", [&]() {
+		r.set_value(std::move(t));
+	}, 0) && ok;
+
+	std::vector<Integer> pool(100, a);
+	std::vector<Integer> values;
+	values.reserve(100);
+	ok = check_allocations("values.push_back(std::move(pool[i])) x 100, after reserve(100)", [&]() {
+		for (int i = 0; i < 100; ++i) {
+			values.push_back(std::move(pool[i]));
+		}
+	}, 0) && ok;
+	ok = check_allocations("values.push_back(...) past the capacity", [&]() {
+		values.push_back(a);
+	}, 1 + once) && ok;
+
+	std::cout << std::endl << (ok ? "all counts within their bounds" : "SOME COUNTS TOO HIGH")
+		<< std::endl;
+
+	return ok ? 0 : 1;
+}
+
+void* counted_allocation(std::size_t size) {
+	++num_allocations;
+
+	void* ptr = std::malloc(size != 0 ? size : 1);
+	if (ptr == nullptr) {
+		throw std::bad_alloc();
+	}
+	return ptr;
+}
+
+template <typename Function>
+bool check_allocations(const std::string& expression, Function f, long bound) {
+	long before = num_allocations;
+	f();
+	long count = num_allocations - before;
+
+	bool ok = count <= bound;
+	std::cout << (ok ? "  PASS " : "  FAIL ") << expression << ": " << count
+		<< " allocations (at most " << bound << ")" << std::endl;
+	return ok;
+}
+
+Integer make_integer(int num_bits) {
+	Integer val(0);
+	for (int i = 0; i < num_bits; ++i) {
+		val.set_bit(i, i % 3 != 1 || i == num_bits - 1);
+	}
+	return val;
+}
@@ -0,0 +1,397 @@
+////////////////////////////////////////////////////////////////////////////////
+// @file hw-03-bench.cpp
+// @mainpage
+//
+// Description: times the fast paths of integer_3 against the slow algorithms
+// they replace, and against each other. Each section is run by naming it on
+// the command line (all of them run if none is named):
+//   powmod   powmod against square-and-multiply with * and %=, for 2048-
+//            and 4096-bit moduli
+//   gcd      gcd, ext_gcd and mod_inverse against Euclid's algorithm with
+//            %=, across operand sizes
+//   mul      multiplication across operand sizes, around the Karatsuba
+//            threshold (rebuild with -DINTEGER_KARATSUBA_THRESHOLD=<limbs>
+//            to compare thresholds)
+//   factor   factor_all throughput for each bit size of its inputs
+//   kernels  the add/sub kernels of each kernel set on long operands
+//   threads  large products on 1, 2, 4, 8 and 16 threads, for choosing the
+//            parallel cutoff
+// Build it with optimization, e.g.
+//   cp integer_3.h integer.h
+//   g++ -std=c++17 -O2 -pthread integer_3.cpp hw-03-bench.cpp
+//
+// Known bugs: None so far!
+////////////////////////////////////////////////////////////////////////////////
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <utility>
+#include <cstdint>
+#include "integer.h"
+
+// The random number generator shared by all sections
+typedef std::mt19937_64 Random;
+
+// Call f repeatedly until at least min_seconds have passed (and at least
+// once).
+// @return the average time of one call, in seconds
+template <typename Function>
+double time_per_call(Function f, double min_seconds = 0.25);
+
+// Format a time in seconds with a unit that keeps it readable, e.g. "12.3 us".
+std::string format_time(double seconds);
+
+// Build a random Integer of exactly num_bits bits (the top bit is 1).
+Integer random_bits(Random& rng, int num_bits);
+
+// The 32-bit words of a random value of exactly num_words words, least
+// significant first, for IntegerView.
+std::vector<std::uint32_t> random_words(Random& rng, std::size_t num_words);
+
+// Build a value of about num_bits bits made of primes of at most 32 bits
+// and one large prime, which is the shape of most random values. (The
+// values with two large prime factors take far longer to split, up to
+// minutes at 200 bits, and a few of them would swamp a throughput table.)
+Integer random_factorable(Random& rng, int num_bits);
+
+// base^exp % mod with square-and-multiply, reducing with operator%= after
+// every product, as it had to be written before powmod.
+Integer powmod_with_remainders(const Integer& base, const Integer& exp,
+	const Integer& mod);
+
+// gcd(a, b) by Euclid's algorithm with operator%=, as it had to be written
+// before gcd.
+Integer gcd_with_remainders(Integer a, Integer b);
+
+// The sections, each printing one table.
+void bench_powmod(Random& rng);
+void bench_gcd(Random& rng);
+void bench_mul(Random& rng);
+void bench_factor(Random& rng);
+void bench_kernels(Random& rng);
+void bench_threads(Random& rng);
+
+int main(int argc, char* argv[]) {
+
+	Random rng(2016);
+	std::vector<std::string> sections(argv + 1, argv + argc);
+	if (sections.empty()) {
+		sections = { "powmod", "gcd", "mul", "factor", "kernels", "threads" };
+	}
+
+	for (std::size_t i = 0; i < sections.size(); ++i) {
+		if (sections[i] == "powmod") {
+			bench_powmod(rng);
+		}
+		else if (sections[i] == "gcd") {
+			bench_gcd(rng);
+		}
+		else if (sections[i] == "mul") {
+			bench_mul(rng);
+		}
+		else if (sections[i] == "factor") {
+			bench_factor(rng);
+		}
+		else if (sections[i] == "kernels") {
+			bench_kernels(rng);
+		}
+		else if (sections[i] == "threads") {
+			bench_threads(rng);
+		}
+		else {
+			std::cout << "unknown section " << sections[i] << std::endl;
+			return 1;
+		}
+		std::cout << std::endl;
+	}
+
+	return 0;
+}
+
+template <typename Function>
+double time_per_call(Function f, double min_seconds) {
+	typedef std::chrono::steady_clock Clock;
+
+	long calls = 0;
+	double elapsed = 0;
+	Clock::time_point start = Clock::now();
+
+	// Double the number of calls until enough time has passed, so that the
+	// clock is read rarely for fast functions.
+	for (long batch = 1; calls == 0 || elapsed < min_seconds; batch *= 2) {
+		for (long i = 0; i < batch; ++i) {
+			f();
+		}
+		calls += batch;
+		elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+	}
+
+	return elapsed / calls;
+}
+
+std::string format_time(double seconds) {
+	std::ostringstream os;
+	os << std::fixed << std::setprecision(2);
+
+	if (seconds < 1e-6) {
+		os << seconds * 1e9 << " ns";
+	}
+	else if (seconds < 1e-3) {
+		os << seconds * 1e6 << " us";
+	}
+	else if (seconds < 1) {
+		os << seconds * 1e3 << " ms";
+	}
+	else {
+		os << seconds << " s";
+	}
+
+	return os.str();
+}
+
+Integer random_bits(Random& rng, int num_bits) {
+	Integer val(0);
+	for (int i = 0; i < num_bits; ++i) {
+		val.set_bit(i, (rng() & 1) != 0 || i == num_bits - 1);
+	}
+	return val;
+}
+
+std::vector<std::uint32_t> random_words(Random& rng, std::size_t num_words) {
+	std::vector<std::uint32_t> words(num_words);
+	for (std::size_t i = 0; i < num_words; ++i) {
+		words[i] = std::uint32_t(rng());
+	}
+	words.back() |= 0x80000000u;
+	return words;
+}
+
+Integer random_factorable(Random& rng, int num_bits) {
+	Integer val(1);
+	while (2 * val.bit_length() < num_bits) {
+		val *= next_prime(random_bits(rng, 2 + int(rng() % 31)));
+	}
+
+	int rest = num_bits - val.bit_length();
+	if (rest >= 2) {
+		val *= next_prime(random_bits(rng, rest));
+	}
+	return val;
+}
+
+Integer powmod_with_remainders(const Integer& base, const Integer& exp,
+	const Integer& mod) {
+
+	Integer result(1);
+	Integer power = base;
+	power %= mod;
+
+	for (int i = 0; i < exp.size(); ++i) {
+		if (exp.get_bit(i)) {
+			result *= power;
+			result %= mod;
+		}
+		power *= power;
+		power %= mod;
+	}
+
+	return result;
+}
+
+Integer gcd_with_remainders(Integer a, Integer b) {
+	while (!b.is_zero()) {
+		a %= b;
+		std::swap(a, b);
+	}
+	return a;
+}
+
+void bench_powmod(Random& rng) {
+	std::cout << "powmod: random base and exponent as long as the modulus" << std::endl;
+	std::cout << "(* and %= are timed on the low " << 16
+		<< " exponent bits and scaled up to the full exponent)" << std::endl;
+	std::cout << std::setw(8) << "bits" << std::setw(8) << "mod"
+		<< std::setw(16) << "* and %=" << std::setw(16) << "powmod"
+		<< std::setw(10) << "speedup" << std::endl;
+
+	const int sizes[] = { 2048, 4096 };
+	const int sample_bits = 16;
+
+	for (int s = 0; s < 2; ++s) {
+		for (int odd = 1; odd >= 0; --odd) {
+			int bits = sizes[s];
+			Integer mod = random_bits(rng, bits);
+			mod.set_bit(0, odd != 0);
+			Integer base = random_bits(rng, bits - 1);
+			Integer exp = random_bits(rng, bits);
+
+			// The low bits of exp, for the slow loop
+			Integer sample(0);
+			for (int i = 0; i < sample_bits; ++i) {
+				sample.set_bit(i, exp.get_bit(i) || i == sample_bits - 1);
+			}
+
+			double slow = time_per_call([&]() {
+				powmod_with_remainders(base, sample, mod);
+			}, 0) * bits / sample_bits;
+			double fast = time_per_call([&]() { powmod(base, exp, mod); });
+
+			std::cout << std::setw(8) << bits << std::setw(8) << (odd ? "odd" : "even")
+				<< std::setw(16) << format_time(slow) << std::setw(16) << format_time(fast)
+				<< std::setw(9) << std::setprecision(0) << std::fixed << slow / fast << "x"
+				<< std::endl;
+		}
+	}
+}
+
+void bench_gcd(Random& rng) {
+	std::cout << "gcd: random operands of the same size" << std::endl;
+	std::cout << std::setw(8) << "bits" << std::setw(16) << "Euclid, %="
+		<< std::setw(16) << "gcd" << std::setw(16) << "ext_gcd"
+		<< std::setw(16) << "mod_inverse" << std::endl;
+
+	const int sizes[] = { 64, 256, 1024, 4096, 16384 };
+
+	for (int s = 0; s < 5; ++s) {
+		Integer a = random_bits(rng, sizes[s]);
+		Integer b = random_bits(rng, sizes[s]);
+		b.set_bit(0, true);
+
+		// a is made a unit modulo b for mod_inverse.
+		while (!(gcd(a, b) == Integer(1))) {
+			a += Integer(1);
+		}
+
+		SignedInteger x, y;
+		double slow = time_per_call([&]() { gcd_with_remainders(a, b); }, 0);
+		double fast = time_per_call([&]() { gcd(a, b); });
+		double extended = time_per_call([&]() { ext_gcd(a, b, x, y); });
+		double inverse = time_per_call([&]() { mod_inverse(a, b); });
+
+		std::cout << std::setw(8) << sizes[s] << std::setw(16) << format_time(slow)
+			<< std::setw(16) << format_time(fast) << std::setw(16) << format_time(extended)
+			<< std::setw(16) << format_time(inverse) << std::endl;
+	}
+}
+
+void bench_mul(Random& rng) {
+	std::cout << "mul: products of two IntegerViews of the same size, on one thread"
+		<< std::endl;
+	std::cout << "(small products mostly time copying the words in and building the"
+		<< std::endl << "SignedInteger result; the threshold shows in the large ones, whose"
+		<< std::endl << "recursion ends in products of threshold size)" << std::endl;
+	std::cout << std::setw(8) << "limbs" << std::setw(10) << "bits"
+		<< std::setw(16) << "time" << std::endl;
+
+	unsigned int previous_threads = max_threads();
+	set_max_threads(1);
+
+	for (std::size_t num_words = 16; num_words <= 4096; num_words *= 2) {
+		std::vector<std::uint32_t> a = random_words(rng, num_words);
+		std::vector<std::uint32_t> b = random_words(rng, num_words);
+		IntegerView va(a.data(), a.size(), false), vb(b.data(), b.size(), false);
+
+		double t = time_per_call([&]() { va * vb; });
+		std::cout << std::setw(8) << num_words << std::setw(10) << 32 * num_words
+			<< std::setw(16) << format_time(t) << std::endl;
+	}
+
+	set_max_threads(previous_threads);
+}
+
+void bench_factor(Random& rng) {
+	std::cout << "factor_all: values made of primes of up to 32 bits and one large"
+		<< std::endl << "prime, on 1 and " << max_threads() << " threads" << std::endl;
+	std::cout << std::setw(8) << "bits" << std::setw(8) << "values"
+		<< std::setw(16) << "1 thread" << std::setw(16) << "all threads" << std::endl;
+
+	const int sizes[] = { 32, 64, 96, 128, 160, 200 };
+
+	for (int s = 0; s < 6; ++s) {
+		int count = (sizes[s] <= 64) ? 1000 : 100;
+		std::vector<Integer> values;
+		for (int i = 0; i < count; ++i) {
+			values.push_back(random_factorable(rng, sizes[s]));
+		}
+
+		double serial = time_per_call([&]() { factor_all(values, 1); }, 0);
+		double parallel = time_per_call([&]() { factor_all(values, 0); }, 0);
+
+		std::cout << std::setw(8) << sizes[s] << std::setw(8) << count
+			<< std::setw(13) << std::setprecision(1) << std::fixed << count / serial
+			<< " /s" << std::setw(13) << count / parallel << " /s" << std::endl;
+	}
+}
+
+void bench_kernels(Random& rng) {
+	std::cout << "kernels: x += y; x -= y on TwosComplementIntegers" << std::endl;
+	std::cout << std::setw(10) << "bits";
+
+	const char* kernel_names[] = { "generic", "avx2", "bmi2" };
+	for (int k = 0; k < 3; ++k) {
+		std::cout << std::setw(16) << kernel_names[k];
+	}
+	std::cout << std::endl;
+
+	std::string previous = active_kernels();
+	const int sizes[] = { 1 << 12, 1 << 16, 1 << 20, 1 << 24 };
+
+	for (int s = 0; s < 4; ++s) {
+		TwosComplementInteger x(SignedInteger(random_bits(rng, sizes[s])));
+		TwosComplementInteger y(SignedInteger(random_bits(rng, sizes[s] - 1)));
+
+		std::cout << std::setw(10) << sizes[s];
+		for (int k = 0; k < 3; ++k) {
+			if (!force_kernels(kernel_names[k])) {
+				std::cout << std::setw(16) << "-";
+				continue;
+			}
+
+			double t = time_per_call([&]() {
+				x += y;
+				x -= y;
+			});
+			std::cout << std::setw(16) << format_time(t);
+		}
+		std::cout << std::endl;
+	}
+
+	force_kernels(previous);
+}
+
+void bench_threads(Random& rng) {
+	std::cout << "threads: products of two IntegerViews of the same size, with the"
+		<< std::endl << "parallel cutoff at 1024 bits (on a machine with fewer cores than"
+		<< std::endl << "threads, the extra threads only add their start-up cost)" << std::endl;
+	std::cout << std::setw(10) << "bits";
+
+	const unsigned int thread_counts[] = { 1, 2, 4, 8, 16 };
+	for (int t = 0; t < 5; ++t) {
+		std::cout << std::setw(14) << thread_counts[t];
+	}
+	std::cout << std::endl;
+
+	unsigned int previous_threads = max_threads();
+	set_parallel_cutoff(1024);
+
+	for (std::size_t num_words = 1 << 9; num_words <= (1 << 17); num_words *= 4) {
+		std::vector<std::uint32_t> a = random_words(rng, num_words);
+		std::vector<std::uint32_t> b = random_words(rng, num_words);
+		IntegerView va(a.data(), a.size(), false), vb(b.data(), b.size(), false);
+
+		std::cout << std::setw(10) << 32 * num_words;
+		for (int t = 0; t < 5; ++t) {
+			set_max_threads(thread_counts[t]);
+			std::cout << std::setw(14) << format_time(time_per_call([&]() { va * vb; }));
+		}
+		std::cout << std::endl;
+	}
+
+	set_max_threads(previous_threads);
+	set_parallel_cutoff(1 << 16);
+}
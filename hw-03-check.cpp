@@ -0,0 +1,1090 @@
+////////////////////////////////////////////////////////////////////////////////
+// @file hw-03-check.cpp
+// @mainpage
+//
+// Description: checks the fast paths of integer_3 against the slow
+// bit-by-bit algorithms Integer started out with, on random operands.
+// Products are compared with shift-and-add multiplication, quotients and
+// remainders with the long division of operator/= and operator%=, sums with
+// add_with_carry, and so on. Every check runs once for each kernel set the
+// CPU supports ("generic", "avx2" and "bmi2"), with a low parallel cutoff so
+// the multi-threaded paths run as well. Build it once for each storage
+// option of Integer:
+//   cp integer_3.h integer.h
+//   g++ -std=c++17 -O2 -pthread integer_3.cpp hw-03-check.cpp
+//   g++ -std=c++17 -O2 -pthread -DINTEGER_COPY_ON_WRITE integer_3.cpp hw-03-check.cpp
+//   g++ -std=c++17 -O2 -pthread -DINTEGER_USE_PMR integer_3.cpp hw-03-check.cpp
+// The program takes an optional random seed, prints one line per check and
+// exits with status 1 if any result differs from the reference.
+//
+// Known bugs: None so far!
+////////////////////////////////////////////////////////////////////////////////
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <cstdlib>
+#include <cstdint>
+#include <stdexcept>
+#include "integer.h"
+
+// The random number generator shared by all checks
+typedef std::mt19937_64 Random;
+
+// Counts the cases of one check and reports the first few failures.
+class Check {
+public:
+	Check(const std::string& name) : name_(name), cases_(0), failures_(0) {}
+
+	// Record the outcome of one case.
+	// @param ok true if the result matched the reference
+	// @param detail printed along with a failure
+	void expect(bool ok, const std::string& detail);
+
+	// Print the summary line of the check.
+	// @return the number of failed cases
+	int report() const;
+
+private:
+	std::string name_;
+	int cases_;
+	int failures_;
+};
+
+// Build a random Integer of at most max_bits bits. Besides uniformly random
+// bits, a few values are all ones or powers of two, to exercise long carry
+// and borrow chains, and a few are 0.
+// @param rng the random number generator
+// @param max_bits the largest bit length to produce
+// @return the random Integer
+Integer random_integer(Random& rng, int max_bits);
+
+// Build a random SignedInteger of at most max_bits bits, negative half of
+// the time.
+SignedInteger random_signed(Random& rng, int max_bits);
+
+// Make a SignedInteger from a magnitude and a sign.
+SignedInteger make_signed(const Integer& mag, bool negative);
+
+// The words of val, least significant first (none for 0), for IntegerView.
+std::vector<std::uint32_t> words_of(const Integer& val);
+
+// Drop the leading zero bits of val, which operator== would otherwise see
+// (operator-= is the public operation that removes them).
+Integer trimmed(Integer val);
+
+// Reference arithmetic, written with the original bit-by-bit algorithms.
+// ref_sub needs lhs >= rhs, and ref_divmod needs rhs != 0.
+Integer ref_add(const Integer& lhs, const Integer& rhs);
+Integer ref_sub(const Integer& lhs, const Integer& rhs);
+Integer ref_mul(const Integer& lhs, const Integer& rhs);
+void ref_divmod(const Integer& lhs, const Integer& rhs, Integer& quot, Integer& rem);
+Integer ref_powmod(const Integer& base, const Integer& exp, const Integer& mod);
+Integer ref_gcd(Integer a, Integer b);
+Integer ref_power(const Integer& base, unsigned int exp);
+
+// Signed reference arithmetic on top of the unsigned one. Division truncates
+// toward zero, and the remainder has the sign of lhs.
+SignedInteger ref_add(const SignedInteger& lhs, const SignedInteger& rhs);
+SignedInteger ref_sub(const SignedInteger& lhs, const SignedInteger& rhs);
+SignedInteger ref_mul(const SignedInteger& lhs, const SignedInteger& rhs);
+SignedInteger ref_div(const SignedInteger& lhs, const SignedInteger& rhs);
+SignedInteger ref_mod(const SignedInteger& lhs, const SignedInteger& rhs);
+
+// The decimal digits of val, computed by doubling a base-10^9 number once
+// for every bit of val.
+std::string ref_decimal(const Integer& val);
+
+// The strings SignedInteger prints for val.
+std::string ref_signed_decimal(const SignedInteger& val);
+
+// Tell if val is prime by trial division (val must be below 2^32).
+bool ref_is_prime(std::uint64_t val);
+
+// The checks, each on count random cases. Each one returns the number of
+// failed cases.
+int check_add_sub(Random& rng, int count);
+int check_mul(Random& rng, int count);
+int check_strings(Random& rng, int count);
+int check_bits(Random& rng, int count);
+int check_signed(Random& rng, int count);
+int check_powmod(Random& rng, int count);
+int check_gcd(Random& rng, int count);
+int check_roots(Random& rng, int count);
+int check_primes(Random& rng, int count);
+int check_factor(Random& rng, int count);
+int check_mod_context(Random& rng, int count);
+int check_view(Random& rng, int count);
+int check_array(Random& rng, int count);
+int check_batch(Random& rng, int count);
+int check_twos_complement(Random& rng, int count);
+int check_fixed(Random& rng, int count);
+int check_expressions(Random& rng, int count);
+
+int main(int argc, char* argv[]) {
+
+	unsigned long seed = (argc > 1) ? std::strtoul(argv[1], nullptr, 10) : 2016;
+	const char* kernel_names[] = { "generic", "avx2", "bmi2" };
+
+#if defined(INTEGER_COPY_ON_WRITE)
+	std::cout << "storage: copy-on-write" << std::endl;
+#elif defined(INTEGER_USE_PMR)
+	std::cout << "storage: pmr" << std::endl;
+#else
+	std::cout << "storage: std::vector<bool>" << std::endl;
+#endif
+
+	// Split products and decimal conversions across threads well below the
+	// default cutoff, so that the threaded code is checked too.
+	set_max_threads(4);
+	set_parallel_cutoff(2048);
+
+	int failures = 0;
+
+	for (int k = 0; k < 3; ++k) {
+		if (!force_kernels(kernel_names[k])) {
+			std::cout << std::endl << "kernels " << kernel_names[k]
+				<< ": not supported by this CPU, skipped" << std::endl;
+			continue;
+		}
+
+		std::cout << std::endl << "kernels " << active_kernels() << ":" << std::endl;
+		Random rng(seed);
+
+		failures += check_add_sub(rng, 300);
+		failures += check_mul(rng, 150);
+		failures += check_strings(rng, 60);
+		failures += check_bits(rng, 200);
+		failures += check_signed(rng, 300);
+		failures += check_powmod(rng, 40);
+		failures += check_gcd(rng, 150);
+		failures += check_roots(rng, 60);
+		failures += check_primes(rng, 300);
+		failures += check_factor(rng, 40);
+		failures += check_mod_context(rng, 100);
+		failures += check_view(rng, 200);
+		failures += check_array(rng, 20);
+		failures += check_batch(rng, 6);
+		failures += check_twos_complement(rng, 300);
+		failures += check_fixed(rng, 200);
+		failures += check_expressions(rng, 100);
+	}
+
+	std::cout << std::endl << (failures == 0 ? "all checks passed" : "SOME CHECKS FAILED")
+		<< std::endl;
+
+	return (failures == 0) ? 0 : 1;
+}
+
+void Check::expect(bool ok, const std::string& detail) {
+	++cases_;
+	if (ok) {
+		return;
+	}
+
+	// Long operands are cut short, since the case number is enough to find
+	// them again with the same seed.
+	++failures_;
+	if (failures_ <= 3) {
+		std::cout << "  " << name_ << " case " << cases_ << " failed: "
+			<< detail.substr(0, 200) << (detail.size() > 200 ? "..." : "") << std::endl;
+	}
+}
+
+int Check::report() const {
+	std::cout << (failures_ == 0 ? "  PASS " : "  FAIL ") << name_ << " (" << cases_
+		<< " cases";
+	if (failures_ != 0) {
+		std::cout << ", " << failures_ << " failed";
+	}
+	std::cout << ")" << std::endl;
+	return failures_;
+}
+
+Integer random_integer(Random& rng, int max_bits) {
+	int num_bits = 1 + int(rng() % max_bits);
+	int shape = int(rng() % 16);
+
+	if (shape == 0) {
+		return Integer(0);
+	}
+
+	Integer val(0);
+	for (int i = 0; i < num_bits; ++i) {
+		bool bit = (rng() & 1) != 0;
+		if (shape == 1) {
+			bit = true; // all ones
+		}
+		else if (shape == 2) {
+			bit = false; // a power of two
+		}
+
+		val.set_bit(i, bit || i == num_bits - 1);
+	}
+
+	return val;
+}
+
+SignedInteger random_signed(Random& rng, int max_bits) {
+	return make_signed(random_integer(rng, max_bits), (rng() & 1) != 0);
+}
+
+SignedInteger make_signed(const Integer& mag, bool negative) {
+	SignedInteger val(mag);
+	if (negative && !mag.is_zero()) {
+		val.negate();
+	}
+	return val;
+}
+
+std::vector<std::uint32_t> words_of(const Integer& val) {
+	std::vector<std::uint32_t> words;
+	if (val.is_zero()) {
+		return words;
+	}
+
+	words.resize((val.size() + 31) / 32, 0);
+	for (int i = 0; i < val.size(); ++i) {
+		if (val.get_bit(i)) {
+			words[i / 32] |= std::uint32_t(1) << (i % 32);
+		}
+	}
+	return words;
+}
+
+Integer trimmed(Integer val) {
+	val -= Integer(0);
+	return val;
+}
+
+Integer ref_add(const Integer& lhs, const Integer& rhs) {
+	int size = (lhs.size() > rhs.size()) ? lhs.size() : rhs.size();
+	Integer sum(0);
+	bool carry = false;
+
+	for (int i = 0; i < size; ++i) {
+		bool bit = lhs.get_bit(i);
+		add_with_carry(bit, rhs.get_bit(i), carry);
+		sum.set_bit(i, bit);
+	}
+
+	if (carry) {
+		sum.set_bit(size, true);
+	}
+
+	return trimmed(sum);
+}
+
+Integer ref_sub(const Integer& lhs, const Integer& rhs) {
+	Integer diff(0);
+	bool borrow = false;
+
+	for (int i = 0; i < lhs.size(); ++i) {
+		int bit = int(lhs.get_bit(i)) - int(rhs.get_bit(i)) - int(borrow);
+		borrow = bit < 0;
+		diff.set_bit(i, (bit & 1) != 0);
+	}
+
+	return trimmed(diff);
+}
+
+Integer ref_mul(const Integer& lhs, const Integer& rhs) {
+	Integer prod(0);
+	Integer shifted = rhs;
+
+	for (int i = 0; i < lhs.size(); ++i) {
+		if (lhs.get_bit(i)) {
+			prod = ref_add(prod, shifted);
+		}
+		shifted.left_shift();
+	}
+
+	return prod;
+}
+
+void ref_divmod(const Integer& lhs, const Integer& rhs, Integer& quot, Integer& rem) {
+	quot = lhs;
+	quot /= rhs;
+	rem = lhs;
+	rem %= rhs;
+}
+
+Integer ref_powmod(const Integer& base, const Integer& exp, const Integer& mod) {
+	Integer quot, result(1), power;
+	ref_divmod(base, mod, quot, power);
+	ref_divmod(result, mod, quot, result);
+
+	for (int i = 0; i < exp.size(); ++i) {
+		if (exp.get_bit(i)) {
+			ref_divmod(ref_mul(result, power), mod, quot, result);
+		}
+		ref_divmod(ref_mul(power, power), mod, quot, power);
+	}
+
+	return result;
+}
+
+Integer ref_gcd(Integer a, Integer b) {
+	while (!b.is_zero()) {
+		Integer quot, rem;
+		ref_divmod(a, b, quot, rem);
+		a = b;
+		b = rem;
+	}
+	return a;
+}
+
+Integer ref_power(const Integer& base, unsigned int exp) {
+	Integer result(1);
+	for (unsigned int i = 0; i < exp; ++i) {
+		result = ref_mul(result, base);
+	}
+	return result;
+}
+
+SignedInteger ref_add(const SignedInteger& lhs, const SignedInteger& rhs) {
+	const Integer& a = lhs.magnitude();
+	const Integer& b = rhs.magnitude();
+
+	if (lhs.is_negative() == rhs.is_negative()) {
+		return make_signed(ref_add(a, b), lhs.is_negative());
+	}
+
+	// Opposite signs: the larger magnitude decides the sign.
+	if (less_than_eq(b, a)) {
+		return make_signed(ref_sub(a, b), lhs.is_negative());
+	}
+	return make_signed(ref_sub(b, a), rhs.is_negative());
+}
+
+SignedInteger ref_sub(const SignedInteger& lhs, const SignedInteger& rhs) {
+	return ref_add(lhs, make_signed(rhs.magnitude(), !rhs.is_negative()));
+}
+
+SignedInteger ref_mul(const SignedInteger& lhs, const SignedInteger& rhs) {
+	return make_signed(ref_mul(lhs.magnitude(), rhs.magnitude()),
+		lhs.is_negative() != rhs.is_negative());
+}
+
+SignedInteger ref_div(const SignedInteger& lhs, const SignedInteger& rhs) {
+	Integer quot, rem;
+	ref_divmod(lhs.magnitude(), rhs.magnitude(), quot, rem);
+	return make_signed(quot, lhs.is_negative() != rhs.is_negative());
+}
+
+SignedInteger ref_mod(const SignedInteger& lhs, const SignedInteger& rhs) {
+	Integer quot, rem;
+	ref_divmod(lhs.magnitude(), rhs.magnitude(), quot, rem);
+	return make_signed(rem, lhs.is_negative());
+}
+
+std::string ref_decimal(const Integer& val) {
+	const std::uint32_t base = 1000000000;
+
+	// Base-10^9 digits, least significant first
+	std::vector<std::uint32_t> digits(1, 0);
+
+	for (int i = val.size() - 1; i >= 0; --i) {
+		std::uint32_t carry = val.get_bit(i) ? 1 : 0;
+		for (std::size_t j = 0; j < digits.size(); ++j) {
+			std::uint32_t d = 2 * digits[j] + carry;
+			carry = (d >= base) ? 1 : 0;
+			digits[j] = d - carry * base;
+		}
+		if (carry) {
+			digits.push_back(carry);
+		}
+	}
+
+	std::ostringstream os;
+	os << digits.back();
+	for (std::size_t j = digits.size() - 1; j-- > 0; ) {
+		std::string chunk = std::to_string(digits[j]);
+		os << std::string(9 - chunk.size(), '0') << chunk;
+	}
+	return os.str();
+}
+
+std::string ref_signed_decimal(const SignedInteger& val) {
+	return (val.is_negative() ? "-" : "+") + ref_decimal(val.magnitude());
+}
+
+bool ref_is_prime(std::uint64_t val) {
+	if (val < 2) {
+		return false;
+	}
+
+	for (std::uint64_t d = 2; d * d <= val; ++d) {
+		if (val % d == 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+int check_add_sub(Random& rng, int count) {
+	Check add("Integer + (against add_with_carry)");
+	Check sub("Integer - (against a bitwise borrow loop)");
+
+	for (int i = 0; i < count; ++i) {
+		Integer a = random_integer(rng, 3000);
+		Integer b = random_integer(rng, 3000);
+
+		add.expect(a + b == ref_add(a, b), a.decimal_string() + " + " + b.decimal_string());
+
+		// Integer subtraction gives the absolute value of the difference.
+		Integer diff = less_than_eq(b, a) ? ref_sub(a, b) : ref_sub(b, a);
+		sub.expect(a - b == diff, a.decimal_string() + " - " + b.decimal_string());
+	}
+
+	return add.report() + sub.report();
+}
+
+int check_mul(Random& rng, int count) {
+	Check mul("Integer * (against shift-and-add)");
+	Check square("Integer * for squares and unbalanced sizes");
+
+	for (int i = 0; i < count; ++i) {
+
+		// Sizes up to a few Karatsuba levels, above the parallel cutoff.
+		Integer a = random_integer(rng, 6000);
+		Integer b = random_integer(rng, (i % 3 == 0) ? 600 : 6000);
+
+		mul.expect(a * b == ref_mul(a, b), a.decimal_string() + " * " + b.decimal_string());
+		square.expect(a * a == ref_mul(a, a), a.decimal_string() + " squared");
+	}
+
+	return mul.report() + square.report();
+}
+
+int check_strings(Random& rng, int count) {
+	Check decimal("decimal_string (against doubling in base 10^9)");
+	Check binary("binary_string");
+
+	for (int i = 0; i < count; ++i) {
+
+		// Large enough for the divide-and-conquer and threaded conversion.
+		Integer a = random_integer(rng, (i % 4 == 0) ? 40000 : 3000);
+		std::string expected = ref_decimal(a);
+
+		decimal.expect(a.decimal_string() == expected, expected);
+
+		std::string bits = "(";
+		for (int j = a.size() - 1; j >= 0; --j) {
+			bits += a.get_bit(j) ? '1' : '0';
+		}
+		bits += ")_2";
+		binary.expect(a.binary_string() == bits, bits);
+	}
+
+	return decimal.report() + binary.report();
+}
+
+int check_bits(Random& rng, int count) {
+	Check ops("&, |, ^ and ~ (against get_bit)");
+	Check counts("popcount, count_trailing_zeros, bit_length, test_range");
+
+	for (int i = 0; i < count; ++i) {
+		Integer a = random_integer(rng, 2000);
+		Integer b = random_integer(rng, 2000);
+		int size = (a.size() > b.size()) ? a.size() : b.size();
+
+		Integer and_bits(0), or_bits(0), xor_bits(0), not_bits(0);
+		for (int j = 0; j < size; ++j) {
+			and_bits.set_bit(j, a.get_bit(j) && b.get_bit(j));
+			or_bits.set_bit(j, a.get_bit(j) || b.get_bit(j));
+			xor_bits.set_bit(j, a.get_bit(j) != b.get_bit(j));
+		}
+		for (int j = 0; j < a.size(); ++j) {
+			not_bits.set_bit(j, !a.get_bit(j));
+		}
+
+		std::string operands = a.decimal_string() + ", " + b.decimal_string();
+		ops.expect((a & b) == trimmed(and_bits), operands);
+		ops.expect((a | b) == trimmed(or_bits), operands);
+		ops.expect((a ^ b) == trimmed(xor_bits), operands);
+		ops.expect(~a == trimmed(not_bits), operands);
+
+		int ones = 0, trailing = -1, length = 0;
+		for (int j = 0; j < a.size(); ++j) {
+			if (a.get_bit(j)) {
+				++ones;
+				length = j + 1;
+				if (trailing < 0) {
+					trailing = j;
+				}
+			}
+		}
+
+		unsigned int lo = unsigned(rng() % (a.size() + 40));
+		unsigned int hi = lo + unsigned(rng() % 100);
+		bool any = false;
+		for (unsigned int j = lo; j < hi; ++j) {
+			any = any || a.get_bit(j);
+		}
+
+		counts.expect(a.popcount() == ones
+			&& a.count_trailing_zeros() == (trailing < 0 ? 0 : trailing)
+			&& a.bit_length() == length
+			&& a.test_range(lo, hi) == any, a.decimal_string());
+	}
+
+	return ops.report() + counts.report();
+}
+
+int check_signed(Random& rng, int count) {
+	Check arith("SignedInteger + - * / %");
+	Check words("SignedInteger machine-word fast path near 2^63");
+	Check strings("SignedInteger strings and ==");
+
+	for (int i = 0; i < count; ++i) {
+
+		// Small values take the machine-word path, larger ones the general one.
+		int max_bits = (i % 2 == 0) ? 64 : 700;
+		SignedInteger a = random_signed(rng, max_bits);
+		SignedInteger b = random_signed(rng, max_bits);
+		std::string operands = a.decimal_string() + ", " + b.decimal_string();
+
+		arith.expect(a + b == ref_add(a, b), "+ " + operands);
+		arith.expect(a - b == ref_sub(a, b), "- " + operands);
+		arith.expect(a * b == ref_mul(a, b), "* " + operands);
+		if (!b.is_zero()) {
+			arith.expect(a / b == ref_div(a, b), "/ " + operands);
+			arith.expect(a % b == ref_mod(a, b), "% " + operands);
+		}
+
+		SignedInteger c = a;
+		++c;
+		arith.expect(c == ref_add(a, SignedInteger(1)), "++ " + operands);
+
+		// Operands just below 2^63 overflow the machine words.
+		std::int64_t x = std::int64_t(rng() >> 1);
+		std::int64_t y = std::int64_t(rng() >> (1 + rng() % 62));
+		SignedInteger sx, sy;
+		sx.set_int64_value((i % 3 == 0) ? -x : x);
+		sy.set_int64_value((i % 5 == 0) ? -y : y);
+		std::string word_operands = sx.decimal_string() + ", " + sy.decimal_string();
+		words.expect(sx + sy == ref_add(sx, sy), "+ " + word_operands);
+		words.expect(sx - sy == ref_sub(sx, sy), "- " + word_operands);
+		words.expect(sx * sy == ref_mul(sx, sy), "* " + word_operands);
+		if (sx.fits_int64()) {
+			words.expect(sx.get_int64_value() == ((i % 3 == 0) ? -x : x), word_operands);
+		}
+
+		strings.expect(a.decimal_string() == ref_signed_decimal(a), ref_signed_decimal(a));
+		strings.expect(a.binary_string() == (a.is_negative() ? "-" : "+")
+			+ a.magnitude().binary_string(), ref_signed_decimal(a));
+		strings.expect((a == b) == (ref_sub(a, b).is_zero()), operands);
+	}
+
+	return arith.report() + words.report() + strings.report();
+}
+
+int check_powmod(Random& rng, int count) {
+	Check odd("powmod, odd moduli (Montgomery)");
+	Check even("powmod, even moduli");
+	Check view("powmod on IntegerViews with negative bases");
+
+	for (int i = 0; i < count; ++i) {
+		Integer base = random_integer(rng, 400);
+		Integer exp = random_integer(rng, 200);
+		Integer mod = random_integer(rng, 300);
+		mod.set_bit(0, i % 2 == 0);
+		if (mod.is_zero() || mod == Integer(1)) {
+			mod = Integer(2 + (i % 2 == 0 ? 1 : 0));
+		}
+
+		std::string operands = base.decimal_string() + " ^ " + exp.decimal_string()
+			+ " mod " + mod.decimal_string();
+		Integer expected = ref_powmod(base, exp, mod);
+		Check& check = mod.get_bit(0) ? odd : even;
+		check.expect(powmod(base, exp, mod) == expected, operands);
+
+		// (-base)^exp is -(base^exp) for odd exponents.
+		std::vector<std::uint32_t> b = words_of(base), e = words_of(exp), m = words_of(mod);
+		Integer result = powmod(IntegerView(b.data(), b.size(), true),
+			IntegerView(e.data(), e.size(), false), IntegerView(m.data(), m.size(), false));
+		if (exp.get_bit(0) && !expected.is_zero()) {
+			expected = ref_sub(mod, expected);
+		}
+		view.expect(result == expected, "-" + operands);
+	}
+
+	return odd.report() + even.report() + view.report();
+}
+
+int check_gcd(Random& rng, int count) {
+	Check plain("gcd and lcm (against Euclid with %=)");
+	Check extended("ext_gcd and mod_inverse");
+
+	for (int i = 0; i < count; ++i) {
+
+		// A shared factor makes the gcd more interesting than 1.
+		Integer common = random_integer(rng, 200);
+		Integer a = random_integer(rng, 1200);
+		Integer b = random_integer(rng, 1200);
+		if (i % 2 == 0 && !common.is_zero()) {
+			a = ref_mul(a, common);
+			b = ref_mul(b, common);
+		}
+
+		std::string operands = a.decimal_string() + ", " + b.decimal_string();
+		Integer g = ref_gcd(a, b);
+		plain.expect(gcd(a, b) == g, operands);
+
+		if (!a.is_zero() && !b.is_zero()) {
+			Integer quot, rem;
+			ref_divmod(ref_mul(a, b), g, quot, rem);
+			plain.expect(lcm(a, b) == quot, operands);
+		}
+
+		SignedInteger x, y;
+		Integer eg = ext_gcd(a, b, x, y);
+		SignedInteger combination = ref_add(ref_mul(SignedInteger(a), x),
+			ref_mul(SignedInteger(b), y));
+		extended.expect(eg == g && combination == SignedInteger(g), operands);
+
+		SignedInteger sa = make_signed(a, i % 3 == 0), sb = make_signed(b, i % 5 == 0);
+		SignedInteger sg = ext_gcd(sa, sb, x, y);
+		extended.expect(sg == SignedInteger(g)
+			&& ref_add(ref_mul(sa, x), ref_mul(sb, y)) == sg, operands);
+
+		if (g == Integer(1) && !b.is_zero() && !(b == Integer(1))) {
+			Integer inv = mod_inverse(a, b);
+			Integer quot, rem;
+			ref_divmod(ref_mul(a, inv), b, quot, rem);
+			extended.expect(rem == Integer(1) && less_than_eq(inv, b), operands);
+		}
+	}
+
+	return plain.report() + extended.report();
+}
+
+int check_roots(Random& rng, int count) {
+	Check square_root("isqrt (r^2 <= v < (r+1)^2)");
+	Check nth_root("iroot (r^n <= v < (r+1)^n)");
+	Check powers("is_perfect_square and is_perfect_power");
+
+	for (int i = 0; i < count; ++i) {
+		Integer v = random_integer(rng, 1500);
+		Integer r = isqrt(v);
+		Integer next = ref_add(r, Integer(1));
+		square_root.expect(less_than_eq(ref_mul(r, r), v)
+			&& !less_than_eq(ref_mul(next, next), v), v.decimal_string());
+
+		unsigned int n = 2 + unsigned(rng() % 6);
+		r = iroot(v, n);
+		next = ref_add(r, Integer(1));
+		nth_root.expect(less_than_eq(ref_power(r, n), v)
+			&& !less_than_eq(ref_power(next, n), v), v.decimal_string());
+
+		Integer base = ref_add(random_integer(rng, 200), Integer(2));
+		Integer square = ref_mul(base, base);
+		powers.expect(is_perfect_square(square)
+			&& !is_perfect_square(ref_add(square, Integer(1)))
+			&& is_perfect_power(ref_power(base, n)), base.decimal_string());
+	}
+
+	return square_root.report() + nth_root.report() + powers.report();
+}
+
+int check_primes(Random& rng, int count) {
+	Check probable("is_probable_prime (against trial division)");
+	Check next("next_prime");
+	Check pseudoprimes("is_probable_prime on pseudoprimes");
+
+	for (int i = 0; i < count; ++i) {
+		std::uint64_t v = rng() >> (40 + rng() % 24);
+		Integer val;
+		val.set_uint64_value(v);
+		probable.expect(is_probable_prime(val, 0) == ref_is_prime(v), val.decimal_string());
+
+		if (i % 10 == 0) {
+			std::uint64_t p = v + 1;
+			while (!ref_is_prime(p)) {
+				++p;
+			}
+			Integer expected;
+			expected.set_uint64_value(p);
+			next.expect(next_prime(val) == expected, val.decimal_string());
+		}
+	}
+
+	// Carmichael numbers and strong pseudoprimes to several small bases
+	const std::uint64_t composites[] = { 561, 41041, 825265, 3215031751ull,
+		2152302898747ull, 3474749660383ull, 341550071728321ull, 3825123056546413051ull };
+	for (std::size_t i = 0; i < sizeof(composites) / sizeof(composites[0]); ++i) {
+		Integer val;
+		val.set_uint64_value(composites[i]);
+		pseudoprimes.expect(!is_probable_prime(val, 0), val.decimal_string());
+	}
+
+	return probable.report() + next.report() + pseudoprimes.report();
+}
+
+int check_factor(Random& rng, int count) {
+	Check factors("factor (product and primality of the factors)");
+	Check all("factor_all");
+
+	std::vector<Integer> values;
+	std::vector<std::vector<Integer> > expected;
+
+	for (int i = 0; i < count; ++i) {
+
+		// Either a random value or a product of primes of up to 34 bits
+		Integer val;
+		if (i % 2 == 0) {
+			val = random_integer(rng, 64);
+		}
+		else {
+			val = Integer(1);
+			for (int j = 0; j < 3; ++j) {
+				Integer p;
+				p.set_uint64_value(rng() >> (30 + rng() % 30));
+				val = ref_mul(val, next_prime(p));
+			}
+		}
+
+		std::vector<Integer> primes = factor(val);
+		Integer product(1);
+		bool ok = true;
+		for (std::size_t j = 0; j < primes.size(); ++j) {
+			product = ref_mul(product, primes[j]);
+			ok = ok && is_probable_prime(primes[j], 5);
+			ok = ok && (j == 0 || less_than_eq(primes[j - 1], primes[j]));
+		}
+		if (val.is_zero() || val == Integer(1)) {
+			ok = ok && primes.empty();
+		}
+		else {
+			ok = ok && product == val;
+		}
+		factors.expect(ok, val.decimal_string());
+
+		values.push_back(val);
+		expected.push_back(primes);
+	}
+
+	std::vector<std::vector<Integer> > results = factor_all(values, 3);
+	for (std::size_t i = 0; i < values.size(); ++i) {
+		bool same = results[i].size() == expected[i].size();
+		for (std::size_t j = 0; same && j < expected[i].size(); ++j) {
+			same = results[i][j] == expected[i][j];
+		}
+		all.expect(same, values[i].decimal_string());
+	}
+
+	return factors.report() + all.report();
+}
+
+int check_mod_context(Random& rng, int count) {
+	Check barrett("ModContext reduce and mul (against %=)");
+	Check ring("ModInteger + - * and inverse");
+
+	for (int i = 0; i < count; ++i) {
+		Integer m = random_integer(rng, 700);
+		m.set_bit(0, i % 2 == 0);
+		if (m.is_zero() || m == Integer(1)) {
+			m = Integer(7);
+		}
+
+		ModContext ctx(m);
+		Integer quot, a, b, expected;
+		ref_divmod(random_integer(rng, 700), m, quot, a);
+		ref_divmod(random_integer(rng, 700), m, quot, b);
+		std::string operands = a.decimal_string() + ", " + b.decimal_string() + " mod "
+			+ m.decimal_string();
+
+		Integer big = random_integer(rng, 2000);
+		ref_divmod(big, m, quot, expected);
+		barrett.expect(ctx.reduce(big) == expected, big.decimal_string());
+
+		ref_divmod(ref_mul(a, b), m, quot, expected);
+		barrett.expect(ctx.mul(a, b) == expected, operands);
+
+		ModInteger ma(a, ctx), mb(b, ctx);
+		ring.expect((ma * mb).value() == expected, "* " + operands);
+
+		ref_divmod(ref_add(a, b), m, quot, expected);
+		ring.expect((ma + mb).value() == expected, "+ " + operands);
+
+		ref_divmod(ref_sub(ref_add(a, m), b), m, quot, expected);
+		ring.expect((ma - mb).value() == expected, "- " + operands);
+
+		if (ref_gcd(a, m) == Integer(1)) {
+			ring.expect((ma * ma.inverse()).value() == Integer(1), "inverse " + operands);
+		}
+	}
+
+	return barrett.report() + ring.report();
+}
+
+int check_view(Random& rng, int count) {
+	Check arith("IntegerView + - * / % and compare");
+	Check misc("IntegerView gcd, to_integer and to_signed_integer");
+
+	for (int i = 0; i < count; ++i) {
+		SignedInteger a = random_signed(rng, 1500);
+		SignedInteger b = random_signed(rng, (i % 2 == 0) ? 1500 : 200);
+		std::vector<std::uint32_t> wa = words_of(a.magnitude()), wb = words_of(b.magnitude());
+		IntegerView va(wa.data(), wa.size(), a.is_negative());
+		IntegerView vb(wb.data(), wb.size(), b.is_negative());
+		std::string operands = a.decimal_string() + ", " + b.decimal_string();
+
+		arith.expect(va + vb == ref_add(a, b), "+ " + operands);
+		arith.expect(va - vb == ref_sub(a, b), "- " + operands);
+		arith.expect(va * vb == ref_mul(a, b), "* " + operands);
+		if (!b.is_zero()) {
+			arith.expect(va / vb == ref_div(a, b), "/ " + operands);
+			arith.expect(va % vb == ref_mod(a, b), "% " + operands);
+		}
+
+		SignedInteger diff = ref_sub(a, b);
+		int expected = diff.is_zero() ? 0 : (diff.is_negative() ? -1 : 1);
+		arith.expect(compare(va, vb) == expected && (va < vb) == (expected < 0)
+			&& (va == vb) == (expected == 0), "compare " + operands);
+
+		misc.expect(gcd(va, vb) == ref_gcd(a.magnitude(), b.magnitude()), operands);
+		misc.expect(va.to_integer() == a.magnitude() && va.to_signed_integer() == a, operands);
+	}
+
+	return arith.report() + misc.report();
+}
+
+int check_array(Random& rng, int count) {
+	Check elements("IntegerArray elements");
+	Check reductions("parallel_sum, parallel_product, parallel_sum_product");
+
+	for (int i = 0; i < count; ++i) {
+		IntegerArray array;
+		std::vector<SignedInteger> values;
+		SignedInteger sum(0), product(1);
+
+		int n = int(rng() % 200);
+		for (int j = 0; j < n; ++j) {
+			SignedInteger val = random_signed(rng, (j % 7 == 0) ? 600 : 60);
+			if (j % 3 == 0 && !val.is_negative()) {
+				array.push_back(val.magnitude());
+			}
+			else {
+				array.push_back(val);
+			}
+			values.push_back(val);
+			sum = ref_add(sum, val);
+			product = ref_mul(product, val);
+		}
+
+		bool same = array.size() == values.size();
+		for (std::size_t j = 0; same && j < values.size(); ++j) {
+			same = array[j].to_signed_integer() == values[j];
+		}
+		elements.expect(same, std::to_string(n) + " values");
+
+		unsigned int num_threads = unsigned(i % 4);
+		SignedInteger s, p;
+		parallel_sum_product(values, s, p, num_threads);
+		reductions.expect(parallel_sum(values, num_threads) == sum
+			&& parallel_product(values, num_threads) == product
+			&& s == sum && p == product, std::to_string(n) + " values");
+
+		parallel_sum_product(array, s, p, num_threads);
+		reductions.expect(parallel_sum(array, num_threads) == sum
+			&& parallel_product(array, num_threads) == product
+			&& s == sum && p == product, std::to_string(n) + " packed values");
+	}
+
+	return elements.report() + reductions.report();
+}
+
+int check_batch(Random& rng, int count) {
+	Check batch("add_batch, sub_batch and mul_batch");
+
+	for (int i = 0; i < count; ++i) {
+
+		// Enough elements for the threaded path, mixing word-sized and large
+		// values.
+		std::size_t n = (i % 2 == 0) ? 5000 : 300;
+		std::vector<Integer> a(n), b(n), sum(n), diff(n), prod(n);
+		for (std::size_t j = 0; j < n; ++j) {
+			int max_bits = (i % 3 == 0 && j % 50 == 0) ? 500 : 62;
+			a[j] = random_integer(rng, max_bits);
+			b[j] = random_integer(rng, max_bits);
+		}
+
+		unsigned int num_threads = unsigned(i % 3);
+		add_batch(a.data(), b.data(), sum.data(), n, num_threads);
+		sub_batch(a.data(), b.data(), diff.data(), n, num_threads);
+		mul_batch(a.data(), b.data(), prod.data(), n, num_threads);
+
+		bool ok = true;
+		for (std::size_t j = 0; ok && j < n; ++j) {
+			Integer d = less_than_eq(b[j], a[j]) ? ref_sub(a[j], b[j]) : ref_sub(b[j], a[j]);
+			ok = sum[j] == ref_add(a[j], b[j]) && diff[j] == d
+				&& prod[j] == ref_mul(a[j], b[j]);
+		}
+
+		// The output may be one of the inputs.
+		std::vector<Integer> c = a;
+		mul_batch(c.data(), b.data(), c.data(), n, num_threads);
+		for (std::size_t j = 0; ok && j < n; ++j) {
+			ok = c[j] == prod[j];
+		}
+
+		batch.expect(ok, std::to_string(n) + " elements");
+	}
+
+	return batch.report();
+}
+
+int check_twos_complement(Random& rng, int count) {
+	Check arith("TwosComplementInteger + - * / % ++ --");
+	Check convert("TwosComplementInteger conversion, strings and compare");
+
+	for (int i = 0; i < count; ++i) {
+		SignedInteger a = random_signed(rng, 700);
+		SignedInteger b = random_signed(rng, (i % 2 == 0) ? 700 : 40);
+		TwosComplementInteger ta(a), tb(b);
+		std::string operands = a.decimal_string() + ", " + b.decimal_string();
+
+		arith.expect((ta + tb).to_signed_integer() == ref_add(a, b), "+ " + operands);
+		arith.expect((ta - tb).to_signed_integer() == ref_sub(a, b), "- " + operands);
+		arith.expect((ta * tb).to_signed_integer() == ref_mul(a, b), "* " + operands);
+		if (!b.is_zero()) {
+			arith.expect((ta / tb).to_signed_integer() == ref_div(a, b), "/ " + operands);
+			arith.expect((ta % tb).to_signed_integer() == ref_mod(a, b), "% " + operands);
+		}
+
+		TwosComplementInteger t = ta;
+		++t;
+		arith.expect(t.to_signed_integer() == ref_add(a, SignedInteger(1)), "++ " + operands);
+		t = ta;
+		--t;
+		arith.expect(t.to_signed_integer() == ref_sub(a, SignedInteger(1)), "-- " + operands);
+		t = ta;
+		t += t;
+		arith.expect(t.to_signed_integer() == ref_add(a, a), "+= itself " + operands);
+
+		convert.expect(ta.to_signed_integer() == a
+			&& (-ta).to_signed_integer() == ref_sub(SignedInteger(0), a), operands);
+		convert.expect(ta.decimal_string() == a.decimal_string()
+			&& ta.binary_string() == a.binary_string(), operands);
+
+		SignedInteger diff = ref_sub(a, b);
+		int expected = diff.is_zero() ? 0 : (diff.is_negative() ? -1 : 1);
+		convert.expect(compare(ta, tb) == expected && (ta < tb) == (expected < 0)
+			&& (ta == tb) == (expected == 0), "compare " + operands);
+	}
+
+	return arith.report() + convert.report();
+}
+
+int check_fixed(Random& rng, int count) {
+#ifdef INTEGER_HAVE_FIXED
+	Check fixed("FixedInteger<256> (against Integer mod 2^256)");
+	Check fixed_signed("FixedSignedInteger<256>");
+
+	Integer modulus(1);
+	for (int j = 0; j < 256; ++j) {
+		modulus.left_shift();
+	}
+
+	for (int i = 0; i < count; ++i) {
+
+		// Values past 2^256 check that the conversion keeps the low bits.
+		Integer a = random_integer(rng, (i % 5 == 0) ? 300 : 256);
+		Integer b = random_integer(rng, (i % 2 == 0) ? 256 : 80);
+		FixedInteger<256> fa(a), fb(b);
+		Integer quot, ra, rb, expected;
+		ref_divmod(a, modulus, quot, ra);
+		ref_divmod(b, modulus, quot, rb);
+		std::string operands = ra.decimal_string() + ", " + rb.decimal_string();
+
+		fixed.expect(fa.to_integer() == ra, operands);
+
+		ref_divmod(ref_add(ra, rb), modulus, quot, expected);
+		fixed.expect((fa + fb).to_integer() == expected, "+ " + operands);
+
+		ref_divmod(ref_sub(ref_add(ra, modulus), rb), modulus, quot, expected);
+		fixed.expect((fa - fb).to_integer() == expected, "- " + operands);
+
+		ref_divmod(ref_mul(ra, rb), modulus, quot, expected);
+		fixed.expect((fa * fb).to_integer() == expected, "* " + operands);
+
+		if (!rb.is_zero()) {
+			Integer rem;
+			ref_divmod(ra, rb, quot, rem);
+			fixed.expect((fa / fb).to_integer() == quot && (fa % fb).to_integer() == rem,
+				"/ % " + operands);
+		}
+
+		// Signed values whose products still fit in 255 bits
+		SignedInteger sa = random_signed(rng, 120), sb = random_signed(rng, 120);
+		FixedSignedInteger<256> sfa(sa), sfb(sb);
+		operands = sa.decimal_string() + ", " + sb.decimal_string();
+
+		fixed_signed.expect((sfa + sfb).to_signed_integer() == ref_add(sa, sb), "+ " + operands);
+		fixed_signed.expect((sfa - sfb).to_signed_integer() == ref_sub(sa, sb), "- " + operands);
+		fixed_signed.expect((sfa * sfb).to_signed_integer() == ref_mul(sa, sb), "* " + operands);
+		if (!sb.is_zero()) {
+			fixed_signed.expect((sfa / sfb).to_signed_integer() == ref_div(sa, sb)
+				&& (sfa % sfb).to_signed_integer() == ref_mod(sa, sb), "/ % " + operands);
+		}
+
+		SignedInteger diff = ref_sub(sa, sb);
+		int expected_order = diff.is_zero() ? 0 : (diff.is_negative() ? -1 : 1);
+		fixed_signed.expect(compare(sfa, sfb) == expected_order, "compare " + operands);
+	}
+
+	// Division by 0 throws, leaving the value unchanged.
+	FixedInteger<256> x(12345);
+	bool threw = false;
+	try {
+		x /= FixedInteger<256>();
+	}
+	catch (const std::domain_error&) {
+		threw = true;
+	}
+	fixed.expect(threw && x == FixedInteger<256>(12345), "12345 / 0");
+
+	FixedSignedInteger<256> sx(-12345);
+	threw = false;
+	try {
+		sx %= FixedSignedInteger<256>();
+	}
+	catch (const std::domain_error&) {
+		threw = true;
+	}
+	fixed_signed.expect(threw && sx == FixedSignedInteger<256>(-12345), "-12345 % 0");
+
+	return fixed.report() + fixed_signed.report();
+#else
+	(void)rng;
+	(void)count;
+	std::cout << "  FixedInteger needs C++14, skipped" << std::endl;
+	return 0;
+#endif
+}
+
+int check_expressions(Random& rng, int count) {
+	Check expressions("evaluate(lazy(...)) expressions");
+
+	for (int i = 0; i < count; ++i) {
+		SignedInteger a = random_signed(rng, 1500), b = random_signed(rng, 1500);
+		SignedInteger c = random_signed(rng, 1500), d = random_signed(rng, 1500);
+		Integer e = random_integer(rng, 1500);
+		std::string operands = a.decimal_string() + ", " + b.decimal_string() + ", "
+			+ c.decimal_string() + ", " + d.decimal_string() + ", " + e.decimal_string();
+
+		SignedInteger expected = ref_sub(ref_add(ref_mul(a, b), c), ref_mul(d, SignedInteger(e)));
+		expressions.expect(evaluate(lazy(a) * b + c - lazy(d) * e) == expected,
+			"a * b + c - d * e, " + operands);
+
+		expected = ref_mul(ref_add(a, SignedInteger(e)), ref_sub(c, d));
+		expressions.expect(evaluate((lazy(a) + e) * (lazy(c) - d)) == expected,
+			"(a + e) * (c - d), " + operands);
+	}
+
+	return expressions.report();
+}
@@ -80,15 +80,15 @@ void get_values(std::istream& is, std::vector<SignedInteger>& values) {
 
 
 void send_values(std::ostream& os, std::vector<SignedInteger>& values) {
-	SignedInteger sum(0);
-	SignedInteger product(1);
+	SignedInteger sum;
+	SignedInteger product;
 
 	for (int i = 0; i < values.size(); ++i) {
 		os << values[i] << std::endl;
-		sum += values[i];
-		product *= values[i];
 	}
 
+	parallel_sum_product(values, sum, product, 0);
+
 	os << "Sum = " << sum << std::endl;
 	os << "Product = " << product << std::endl;
 }
\ No newline at end of file
@@ -11,23 +11,134 @@
 
 #include "integer.h"
 #include <iostream>
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <utility>
+
+// Multiplication and the number-theoretic routines would be far too slow if
+// they were written in terms of the bit-serial Integer operators. Internally
+// they work on "limbs": 32-bit words stored from least to most significant. A
+// Limbs value never has leading (most significant) zero limbs, so the value 0
+// is stored as an empty vector. The limb helpers are defined further below.
+typedef std::vector<std::uint32_t> Limbs;
+
+static Limbs to_limbs(const Integer& val);
+static Integer from_limbs(const Limbs& a);
+static Limbs mul(const Limbs& a, const Limbs& b);
+static std::string to_decimal(Limbs a);
+
+SharedBits::SharedBits() : block_(new Block) {
+	block_->refs = 1;
+}
+
+SharedBits::SharedBits(const SharedBits& other) : block_(other.block_) {
+	if (block_) {
+		block_->refs.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+SharedBits::SharedBits(SharedBits&& other) noexcept : block_(other.block_) {
+	other.block_ = nullptr;
+}
+
+SharedBits& SharedBits::operator=(const SharedBits& other) {
+
+	// release() clears block_, which is also other.block_ when a SharedBits
+	// is assigned to itself.
+	Block* block = other.block_;
+	if (block) {
+		block->refs.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	release();
+	block_ = block;
+	return *this;
+}
+
+SharedBits& SharedBits::operator=(SharedBits&& other) noexcept {
+	std::swap(block_, other.block_);
+	return *this;
+}
+
+SharedBits::~SharedBits() {
+	release();
+}
+
+void SharedBits::release() {
+
+	// The acquire/release ordering makes every use of the bits by the other
+	// owners happen before the last owner deletes (or modifies) them.
+	if (block_ && block_->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+		delete block_;
+	}
+	block_ = nullptr;
+}
+
+std::vector<bool>& SharedBits::unshare() {
+	if (!block_) {
+		block_ = new Block;
+		block_->refs = 1;
+	}
+	else if (block_->refs.load(std::memory_order_acquire) != 1) {
+		Block* copy = new Block;
+		copy->refs = 1;
+		copy->bits = block_->bits;
+
+		release();
+		block_ = copy;
+	}
+
+	return block_->bits;
+}
+
+#ifdef INTEGER_USE_PMR
+
+// The resource selected by set_integer_resource (null for the default one).
+static thread_local std::pmr::memory_resource* current_resource = nullptr;
+
+std::pmr::memory_resource* integer_resource() {
+	return current_resource ? current_resource : std::pmr::get_default_resource();
+}
+
+std::pmr::memory_resource* set_integer_resource(std::pmr::memory_resource* resource) {
+	std::pmr::memory_resource* previous = current_resource;
+	current_resource = resource;
+	return previous;
+}
+
+// A copied vector would otherwise allocate from the default resource rather
+// than from the calling thread's current one.
+Integer::Integer(const Integer& val) : bits_(val.bits_, integer_resource()) {
+}
+
+#else
+
+Integer::Integer(const Integer& val) : bits_(val.bits_) {
+}
+
+#endif
 
 Integer::Integer() {
-	bits_.push_back(false);
+	auto& bits = mutable_bits();
+	bits.push_back(false);
 }
 
 Integer::Integer(unsigned int val) {
+	auto& bits = mutable_bits();
 
 	// If val is 0, bits_ should be {false}
 	if (val == 0) {
-		bits_.push_back(false);
+		bits.push_back(false);
 		return;
 	}
 
 	// Read the bits of val by repeatedly dividing by 2 and checking the
 	// remainder % 2. Push bits to bits_.
 	while (val != 0) {
-		bits_.push_back(val % 2 == 1);
+		bits.push_back(val % 2 == 1);
 		val /= 2;
 	}
 }
@@ -58,25 +169,10 @@ std::string Integer::binary_string() const {
 
 std::string Integer::decimal_string() const {
 
-	if (is_zero()) {
-		return "0";
-	}
-
-	Integer copy = *this;
-	Integer ten(10);
-
-	std::string str = "";
-	Integer cur_digit;
-
-	while (!copy.is_zero()) {
-		cur_digit = copy % ten;
-		str += ('0' + cur_digit.get_int_value());
-		copy /= 10;
-	}
-
-	reverse(str);
-
-	return str;
+	// Peeling off one digit at a time with % 10 and / 10 takes quadratic
+	// time with a large constant; to_decimal splits the value by powers of
+	// ten instead, on several threads for very large values.
+	return to_decimal(to_limbs(*this));
 }
 
 bool Integer::get_bit(unsigned int index) const {
@@ -87,28 +183,31 @@ bool Integer::get_bit(unsigned int index) const {
 }
 
 void Integer::set_bit(unsigned int index, bool value) {
+	auto& bits = mutable_bits();
 
-	if (index < bits_.size()) {
+	if (index < bits.size()) {
 
-		bits_[index] = value;
+		bits[index] = value;
 
 	}
 	else {
 
-		bits_.push_back(value);
+		bits.push_back(value);
 
 	}
 }
 
 void Integer::left_shift() {
+	auto& bits = mutable_bits();
 
 	// push "false" to the first position of bits_
-	bits_.insert(bits_.begin(), false);
+	bits.insert(bits.begin(), false);
 
 }
 
 void Integer::right_shift() {
-	bits_.erase(bits_.begin());
+	auto& bits = mutable_bits();
+	bits.erase(bits.begin());
 }
 
 bool Integer::is_zero() const {
@@ -131,32 +230,62 @@ unsigned int Integer::get_int_value() const {
 	return i_value;
 }
 
-// "set_value" could be made more efficient by
-// updating values of bits_ rather than always deleting values,
-// then pushing new values.
-void Integer::set_value(const Integer& val) {
-	// the size of this instance
-	int max_index = size() - 1;
+std::uint64_t Integer::get_uint64_value() const {
+	std::uint64_t value = 0;
+	int size = (bits_.size() < 64) ? bits_.size() : 64;
+
+	for (int i = 0; i < size; ++i) {
+		if (bits_[i]) {
+			value |= std::uint64_t(1) << i;
+		}
+	}
 
-	// remove everything from bits_
-	for (int i = 0; i <= max_index; ++i) {
-		bits_.pop_back();
+	return value;
+}
+
+void Integer::set_uint64_value(std::uint64_t val) {
+	auto& bits = mutable_bits();
+
+	// Shrinking bits_ keeps its capacity, so no memory is allocated unless
+	// the new value has more bits than this Integer ever had.
+	int num_bits = 1;
+	while (num_bits < 64 && (val >> num_bits) != 0) {
+		++num_bits;
+	}
+
+	bits.resize(num_bits);
+	for (int i = 0; i < num_bits; ++i) {
+		bits[i] = (val >> i) & 1;
 	}
+}
+
+void Integer::set_value(const Integer& val) {
 
-	max_index = val.size() - 1;
+	// Assigning a vector reuses its storage when it is large enough, and
+	// copies the bits a word at a time. (A SharedBits just shares them.)
+	bits_ = val.bits_;
+}
+
+void Integer::set_value(Integer&& val) {
+#ifdef INTEGER_USE_PMR
 
-	// add the bits from val to bits_
-	for (int i = 0; i <= max_index; ++i) {
-		bits_.push_back(val.get_bit(i));
+	// Vectors can only swap storage if it comes from the same resource.
+	if (bits_.get_allocator() != val.bits_.get_allocator()) {
+		bits_ = val.bits_;
+		return;
 	}
+#endif
+
+	bits_.swap(val.bits_);
 }
 
 void Integer::complement() {
-	int size = bits_.size();
+	auto& bits = mutable_bits();
+	int size = bits.size();
 
 	// Flip each bit of bits_
 	for (int i = 0; i < size; ++i) {
-		bits_[i] = !bits_[i];
+		bits[i] = !bits[i];
 	}
 
 	// Make sure there aren't any trailing zeros.
@@ -164,145 +293,97 @@ void Integer::complement() {
 }
 
 Integer& Integer::operator+=(const Integer& rhs) {
-	int lhs_max_index = bits_.size() - 1;
-	int rhs_max_index = rhs.size() - 1;
+	auto& bits = mutable_bits();
+	int rhs_size = rhs.size();
+
+	// Make room for the bits of rhs (the extra bits are 0).
+	if ((int)bits.size() < rhs_size) {
+		bits.resize(rhs_size, false);
+	}
 
-	// max_index is the larger of the maximum indices of this instance and rhs
-	int max_index = (lhs_max_index > rhs_max_index) ? lhs_max_index : rhs_max_index;
+	int size = bits.size();
 
 	// the carry bit from adding bits
 	bool carry = false;
 
-	// the current bits from lhs and rhs, respectively
-	bool cur_lhs_bit, cur_rhs_bit;
+	// Add the bits of rhs to the bits in the same position of this instance,
+	// along with the carry bit from adding at the previous index. Working on
+	// bits_ directly (rather than through get_bit, set_bit and add_with_carry)
+	// keeps this loop short for very long Integers.
+	for (int i = 0; i < rhs_size; ++i) {
+		bool lhs_bit = bits[i];
+		bool rhs_bit = rhs.bits_[i];
 
+		bits[i] = (lhs_bit != rhs_bit) != carry;
+		carry = carry ? (lhs_bit || rhs_bit) : (lhs_bit && rhs_bit);
+	}
 
-	// Loop through the bit values of this instance and rhs and add bits
-	// in each position, along with the carry bit from adding at the previous
-	// index. 
-	for (int i = 0; i <= max_index; ++i) {
-		cur_lhs_bit = get_bit(i);
-		cur_rhs_bit = rhs.get_bit(i);
-
-		add_with_carry(cur_lhs_bit, cur_rhs_bit, carry);
-
-		set_bit(i, cur_lhs_bit);
+	// Past the end of rhs, the carry only needs to ripple through a run of 1s.
+	for (int i = rhs_size; carry && i < size; ++i) {
+		carry = bits[i];
+		bits[i] = !bits[i];
 	}
 
 	// If there is a carry bit after adding all bits, append it to the end of bits_
 	if (carry) {
-		bits_.push_back(carry);
+		bits.push_back(carry);
 	}
 
 	return *this;
 }
 
-// The operator-= works as follows. Suppose we want to compute
-// lhs -= rhs. We will assume that lhs and rhs have the same number of bits, and call
-// this number k. That is k = lhs.size() which is equal to rhs.size(). The *complement*
-// of rhs is the Integer whose bits are the opposite of rhs. Observe that the value of
-// rhs's complement, which we'll denote by comp(rhs), is 2^(k+1) - rhs - 1. Thus we have
-//   lhs - rhs = lhs + comp(rhs) - 2^(k+1) + 1.
-// Therefore, in order to subtract rhs from lhs, it suffices to *add* comp(rhs) to lhs
-// and subtract 2^(k+1) and add 1. Subtracting 2^(k+1) is easy because its binary
-// representation is just 1 followed by k 0's.
-//
-// We can use the observation above in order to implement operator-= using addition!
-// The idea is to add lhs+=(comp(rhs) + 1). If the finaly carry bit is 1, then the result
-// is at least 2^(k+1), so lhs - rhs is non-negative, and we simply throw away the carry
-// bit to compute lhs - rhs = lhs + comp(rhs) + 1 - 2^(k+1). On the other hand, if the
-// final carry bit is 0, then we must have had lhs - rhs < 0. In this case, taking the
-// complement of lhs + comp(rhs) gives rhs - lhs. So the function actually assigns the
-// value |lhs - rhs| to lhs!!
+// The operator-= assigns the value |lhs - rhs| to lhs. It first works out which
+// of the two is larger (usually decided by their sizes or leading bits), and
+// then subtracts the smaller from the larger in a single pass, with a borrow
+// bit in place of the carry bit of addition.
 Integer& Integer::operator-=(const Integer& rhs) {
+	auto& bits = mutable_bits();
 
-	//std::cout << "Subtracting: " << binary_string() << " - " << rhs.binary_string() << " = ";
-
-	// if this and rhs have the same value, set this one to 0
-	if ((*this) == rhs) {
-		Integer zero(0);
-		set_value(zero);
-
-		//std::cout << binary_string();
-
-		return *this;
-	}
-
-	int lhs_max_index = bits_.size() - 1;
-	int rhs_max_index = rhs.size() - 1;
-
-	// max_index is the larger of the maximum indices of this instance and rhs
-	int max_index = (lhs_max_index > rhs_max_index) ? lhs_max_index : rhs_max_index;
-
-	// the carry bit from adding bits
-	bool carry = false;
-
-	// the current bits from lhs and rhs, respectively
-	bool cur_lhs_bit, cur_rhs_bit;
-
+	// If rhs is larger, compute rhs - lhs instead.
+	bool rhs_larger = !less_than_eq(rhs, *this);
 
-	// Loop through the bit values of this instance and rhs and add bits
-	// in each position, along with the carry bit from adding at the previous
-	// index. 
-	for (int i = 0; i <= max_index; ++i) {
-		cur_lhs_bit = get_bit(i);
-		cur_rhs_bit = rhs.get_bit(i);
-
-		// Note that we add the complement to cur_rhs_bit!
-		add_with_carry(cur_lhs_bit, !cur_rhs_bit, carry);
-
-		set_bit(i, cur_lhs_bit);
+	int rhs_size = rhs.size();
+	if ((int)bits.size() < rhs_size) {
+		bits.resize(rhs_size, false);
 	}
 
-	// If there is a carry bit after adding all bits, ignore it, and increment 
-	if (carry) {
+	int size = bits.size();
 
-		// This code gets called if the difference is positive
-		// Note that we need to implement the Integer version of ++, not
-		// the SignedInteger version here!
-		Integer::operator++();
+	// the borrow bit from subtracting bits
+	bool borrow = false;
 
-		remove_trailing_zeros();
+	for (int i = 0; i < size; ++i) {
 
-	}
-	else {
+		// Once rhs is exhausted, only a borrow can change the remaining bits
+		// of the larger value (which is this instance).
+		if (i >= rhs_size && !borrow) {
+			break;
+		}
 
-		// This code gets called if the difference is negative
-		complement();
+		bool larger_bit = bits[i];
+		bool smaller_bit = (i < rhs_size) ? rhs.bits_[i] : false;
+		if (rhs_larger) {
+			bool bit = larger_bit;
+			larger_bit = smaller_bit;
+			smaller_bit = bit;
+		}
 
+		bits[i] = (larger_bit != smaller_bit) != borrow;
+		borrow = larger_bit ? (smaller_bit && borrow) : (smaller_bit || borrow);
 	}
 
-	//std::cout << binary_string() << std::endl;
+	remove_trailing_zeros();
 
 	return *this;
 }
 
-Integer& Integer::operator*=(Integer rhs) {
-
-	// If rhs is 0, set the value to 0 (= rhs)
-	if (rhs.size() == 1 && rhs.get_bit(0) == false) {
-		set_value(rhs);
-	}
-
-
-	Integer new_value(0); // the new value (after multiplication)
-
-	int max_index = bits_.size() - 1;
-
-	// Loop through each bit of this instance and add the corresponding
-	// "shifts" of rhs to new_value. For example, if we see a 1 in the k-th
-	// bit of this instance, add the k-th shift of rhs to new_value.
-	for (int i = 0; i <= max_index; ++i) {
+Integer& Integer::operator*=(const Integer& rhs) {
 
-		if (bits_[i]) {
-			new_value += rhs;
-		}
-
-		rhs.left_shift();
-	}
-
-	// Assign this instance the value of new_value.
-	set_value(new_value);
+	// Multiplying bit by bit (adding a shift of rhs for every 1 bit of this
+	// instance) takes time proportional to the product of the sizes, with a
+	// large constant. Instead, multiply 32-bit words, which also lets very
+	// large products use Karatsuba's method on several threads.
+	set_value(from_limbs(mul(to_limbs(*this), to_limbs(rhs))));
 
 	return *this;
 }
@@ -382,20 +463,118 @@ Integer Integer::operator++(int unused) {
 	return a;
 }
 
+Integer& Integer::operator&=(const Integer& rhs) {
+	auto& bits = mutable_bits();
+	int size = bits.size();
+	int rhs_size = rhs.size();
+
+	// Bits past the end of rhs are 0, so they clear the bits of this Integer.
+	if (size > rhs_size) {
+		bits.resize(rhs_size);
+		size = rhs_size;
+	}
+
+	for (int i = 0; i < size; ++i) {
+		bits[i] = bits[i] && rhs.bits_[i];
+	}
+
+	remove_trailing_zeros();
+
+	return *this;
+}
+
+Integer& Integer::operator|=(const Integer& rhs) {
+	auto& bits = mutable_bits();
+	int rhs_size = rhs.size();
+
+	if ((int)bits.size() < rhs_size) {
+		bits.resize(rhs_size, false);
+	}
+
+	for (int i = 0; i < rhs_size; ++i) {
+		bits[i] = bits[i] || rhs.bits_[i];
+	}
+
+	return *this;
+}
+
+Integer& Integer::operator^=(const Integer& rhs) {
+	auto& bits = mutable_bits();
+	int rhs_size = rhs.size();
+
+	if ((int)bits.size() < rhs_size) {
+		bits.resize(rhs_size, false);
+	}
+
+	for (int i = 0; i < rhs_size; ++i) {
+		bits[i] = (bits[i] != rhs.bits_[i]);
+	}
+
+	// Equal leading bits cancel out.
+	remove_trailing_zeros();
+
+	return *this;
+}
+
+int Integer::popcount() const {
+	int count = 0;
+	int size = bits_.size();
+
+	for (int i = 0; i < size; ++i) {
+		if (bits_[i]) {
+			++count;
+		}
+	}
+
+	return count;
+}
+
+int Integer::count_trailing_zeros() const {
+	int size = bits_.size();
+
+	for (int i = 0; i < size; ++i) {
+		if (bits_[i]) {
+			return i;
+		}
+	}
+
+	// The Integer is 0
+	return 0;
+}
+
+int Integer::bit_length() const {
+	return is_zero() ? 0 : bits_.size();
+}
+
+bool Integer::test_range(unsigned int lo, unsigned int hi) const {
+	if (hi > bits_.size()) {
+		hi = bits_.size();
+	}
+
+	for (unsigned int i = lo; i < hi; ++i) {
+		if (bits_[i]) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
 void Integer::remove_trailing_zeros() {
+	auto& bits = mutable_bits();
 
-	int i = bits_.size() - 1;
+	int i = bits.size() - 1;
 
 	// Starting from the largest index in bits_, pop_back values until
 	// we see the first 1 ("true")
-	while ((i > 0) && !bits_[i]) {
-		bits_.pop_back();
+	while ((i > 0) && !bits[i]) {
+		bits.pop_back();
 		--i;
 	}
 
 	// If bits_ is empty, push a 0 ("false") onto bits_
-	if (bits_.size() == 0) {
-		bits_.push_back(false);
+	if (bits.size() == 0) {
+		bits.push_back(false);
 	}
 }
 
@@ -444,6 +623,23 @@ Integer operator*(Integer lhs, const Integer& rhs) {
 	return lhs;
 }
 
+Integer operator+(const Integer& lhs, Integer&& rhs) {
+	rhs += lhs;
+	return std::move(rhs);
+}
+
+Integer operator-(const Integer& lhs, Integer&& rhs) {
+
+	// |lhs - rhs| = |rhs - lhs|
+	rhs -= lhs;
+	return std::move(rhs);
+}
+
+Integer operator*(const Integer& lhs, Integer&& rhs) {
+	rhs *= lhs;
+	return std::move(rhs);
+}
+
 Integer operator/(Integer lhs, const Integer& rhs) {
 	lhs /= rhs;
 	return lhs;
@@ -454,6 +650,41 @@ Integer operator%(Integer lhs, const Integer& rhs) {
 	return lhs;
 }
 
+Integer operator&(Integer lhs, const Integer& rhs) {
+	lhs &= rhs;
+	return lhs;
+}
+
+Integer operator|(Integer lhs, const Integer& rhs) {
+	lhs |= rhs;
+	return lhs;
+}
+
+Integer operator^(Integer lhs, const Integer& rhs) {
+	lhs ^= rhs;
+	return lhs;
+}
+
+Integer operator&(const Integer& lhs, Integer&& rhs) {
+	rhs &= lhs;
+	return std::move(rhs);
+}
+
+Integer operator|(const Integer& lhs, Integer&& rhs) {
+	rhs |= lhs;
+	return std::move(rhs);
+}
+
+Integer operator^(const Integer& lhs, Integer&& rhs) {
+	rhs ^= lhs;
+	return std::move(rhs);
+}
+
+Integer operator~(Integer val) {
+	val.complement();
+	return val;
+}
+
 bool operator==(const Integer& lhs, const Integer& rhs) {
 	int size = lhs.size();
 
@@ -532,7 +763,7 @@ SignedInteger::SignedInteger(int val) : Integer(absolute_value(val)) {
 	neg_ = (val < 0);
 }
 
-SignedInteger::SignedInteger(Integer& val) : Integer(val) {
+SignedInteger::SignedInteger(const Integer& val) : Integer(val) {
 	neg_ = false;
 }
 
@@ -550,7 +781,26 @@ std::string SignedInteger::decimal_string() const {
 	return str;
 }
 
+std::int64_t SignedInteger::get_int64_value() const {
+	std::int64_t value = std::int64_t(get_uint64_value());
+	return neg_ ? -value : value;
+}
+
+void SignedInteger::set_int64_value(std::int64_t val) {
+	neg_ = (val < 0);
+
+	// Negate as unsigned, so that -2^63 does not overflow.
+	std::uint64_t magnitude = std::uint64_t(val);
+	set_uint64_value(neg_ ? 0 - magnitude : magnitude);
+}
+
 SignedInteger& SignedInteger::operator+=(const SignedInteger& rhs) {
+	std::int64_t sum;
+	if (fits_int64() && rhs.fits_int64()
+		&& !__builtin_add_overflow(get_int64_value(), rhs.get_int64_value(), &sum)) {
+		set_int64_value(sum);
+		return *this;
+	}
 
 	// If this and rhs have the same sign, just do Integer addition
 	if (neg_ == rhs.is_negative()) {
@@ -576,17 +826,39 @@ SignedInteger& SignedInteger::operator+=(const SignedInteger& rhs) {
 
 SignedInteger& SignedInteger::operator-=(const SignedInteger& rhs) {
 
-	// Subtraction is just adding the opposite!
-	SignedInteger negative_rhs = rhs;
-	negative_rhs.negate();
+	// x - x = 0
+	if (this == &rhs) {
+		set_uint64_value(0);
+		neg_ = false;
+		return *this;
+	}
 
-	operator+=(negative_rhs);
+	std::int64_t diff;
+	if (fits_int64() && rhs.fits_int64()
+		&& !__builtin_sub_overflow(get_int64_value(), rhs.get_int64_value(), &diff)) {
+		set_int64_value(diff);
+		return *this;
+	}
 
+	// Subtraction is just adding the opposite! Rather than copying rhs to
+	// negate it, use a - b = -((-a) + b).
+	negate();
+	operator+=(rhs);
+
+	if (!is_zero()) {
+		negate();
+	}
 
 	return *this;
 }
 
 SignedInteger& SignedInteger::operator*=(const SignedInteger& rhs) {
+	std::int64_t prod;
+	if (fits_int64() && rhs.fits_int64()
+		&& !__builtin_mul_overflow(get_int64_value(), rhs.get_int64_value(), &prod)) {
+		set_int64_value(prod);
+		return *this;
+	}
 
 	Integer::operator*=(rhs);
 
@@ -594,25 +866,60 @@ SignedInteger& SignedInteger::operator*=(const SignedInteger& rhs) {
 		neg_ = !neg_;
 	}
 
+	// 0 is not negative (and the fast path above never makes it so).
+	if (is_zero()) {
+		neg_ = false;
+	}
+
 	return *this;
 }
 
 SignedInteger& SignedInteger::operator/=(const SignedInteger& rhs) {
+
+	// Both round towards 0. Neither value can be -2^63, so the quotient
+	// always fits; division by 0 is left to Integer to report.
+	if (fits_int64() && rhs.fits_int64() && !rhs.is_zero()) {
+		set_int64_value(get_int64_value() / rhs.get_int64_value());
+		return *this;
+	}
+
 	Integer::operator/=(rhs);
 
 	if (rhs.is_negative()) {
 		neg_ = !neg_;
 	}
 
+	if (is_zero()) {
+		neg_ = false;
+	}
+
 	return *this;
 }
 
 SignedInteger& SignedInteger::operator%=(const SignedInteger& rhs) {
+
+	// Like the slow path below, C++ gives the remainder the sign of *this.
+	if (fits_int64() && rhs.fits_int64() && !rhs.is_zero()) {
+		set_int64_value(get_int64_value() % rhs.get_int64_value());
+		return *this;
+	}
+
 	Integer::operator%=(rhs);
+
+	if (is_zero()) {
+		neg_ = false;
+	}
+
 	return *this;
 }
 
 SignedInteger& SignedInteger::operator++() {
+	std::int64_t next;
+	if (fits_int64() && !__builtin_add_overflow(get_int64_value(), 1, &next)) {
+		set_int64_value(next);
+		return *this;
+	}
+
 	SignedInteger one(1);
 	return operator+=(one);
 }
@@ -638,6 +945,27 @@ SignedInteger operator*(SignedInteger lhs, const SignedInteger& rhs) {
 	return lhs;
 }
 
+SignedInteger operator+(const SignedInteger& lhs, SignedInteger&& rhs) {
+	rhs += lhs;
+	return std::move(rhs);
+}
+
+SignedInteger operator-(const SignedInteger& lhs, SignedInteger&& rhs) {
+
+	// lhs - rhs = -(rhs - lhs)
+	rhs -= lhs;
+	if (!rhs.is_zero()) {
+		rhs.negate();
+	}
+
+	return std::move(rhs);
+}
+
+SignedInteger operator*(const SignedInteger& lhs, SignedInteger&& rhs) {
+	rhs *= lhs;
+	return std::move(rhs);
+}
+
 SignedInteger operator/(SignedInteger lhs, const SignedInteger& rhs) {
 	lhs /= rhs;
 	return lhs;
@@ -648,6 +976,16 @@ SignedInteger operator%(SignedInteger lhs, const SignedInteger& rhs) {
 	return lhs;
 }
 
+bool operator==(const SignedInteger& lhs, const SignedInteger& rhs) {
+
+	// 0 equals -0 (as left behind by negate()).
+	if (lhs.is_negative() != rhs.is_negative() && !lhs.is_zero()) {
+		return false;
+	}
+
+	return lhs.magnitude() == rhs.magnitude();
+}
+
 unsigned int absolute_value(int n) {
 	if (n >= 0) {
 		return n;
@@ -727,3 +1065,3916 @@ std::istream& operator >> (std::istream& is, SignedInteger& val){
 }
 
 
+
+
+// Remove the most significant zero limbs of a.
+static void trim(Limbs& a) {
+	while (!a.empty() && a.back() == 0) {
+		a.pop_back();
+	}
+}
+
+// Read the bits of val into limbs.
+static Limbs to_limbs(const Integer& val) {
+	int size = val.size();
+	Limbs a((size + 31) / 32, 0);
+
+	for (int i = 0; i < size; ++i) {
+		if (val.get_bit(i)) {
+			a[i / 32] |= (std::uint32_t(1) << (i % 32));
+		}
+	}
+
+	trim(a);
+	return a;
+}
+
+// Build an Integer from (trimmed) limbs.
+static Integer from_limbs(const Limbs& a) {
+	Integer val(0);
+
+	if (a.empty()) {
+		return val;
+	}
+
+	// The top limb is non-zero, so only its leading zeros need skipping.
+	int num_bits = 32 * (a.size() - 1);
+	for (std::uint32_t top = a.back(); top != 0; top >>= 1) {
+		++num_bits;
+	}
+
+	for (int i = 0; i < num_bits; ++i) {
+		val.set_bit(i, (a[i / 32] >> (i % 32)) & 1);
+	}
+
+	return val;
+}
+
+// Compare two limb values.
+// @return -1, 0 or 1 if a is less than, equal to or greater than b.
+static int compare(const Limbs& a, const Limbs& b) {
+	if (a.size() != b.size()) {
+		return (a.size() < b.size()) ? -1 : 1;
+	}
+
+	for (int i = a.size() - 1; i >= 0; --i) {
+		if (a[i] != b[i]) {
+			return (a[i] < b[i]) ? -1 : 1;
+		}
+	}
+
+	return 0;
+}
+
+// Add the n-limb values a and b (plus carry_in) into r, one limb at a time.
+// @return the carry out of the top limb
+static std::uint32_t add_n_scalar(std::uint32_t* r, const std::uint32_t* a,
+	const std::uint32_t* b, std::size_t n, std::uint32_t carry_in) {
+
+	std::uint64_t carry = carry_in;
+	for (std::size_t i = 0; i < n; ++i) {
+		carry += std::uint64_t(a[i]) + b[i];
+		r[i] = std::uint32_t(carry);
+		carry >>= 32;
+	}
+	return std::uint32_t(carry);
+}
+
+// Subtract the n-limb value b (plus borrow_in) from a into r.
+// @return the borrow out of the top limb
+static std::uint32_t sub_n_scalar(std::uint32_t* r, const std::uint32_t* a,
+	const std::uint32_t* b, std::size_t n, std::uint32_t borrow_in) {
+
+	std::uint32_t borrow = borrow_in;
+	for (std::size_t i = 0; i < n; ++i) {
+		std::uint64_t t = std::uint64_t(a[i]) - b[i] - borrow;
+		r[i] = std::uint32_t(t);
+		borrow = std::uint32_t(t >> 63);
+	}
+	return borrow;
+}
+
+// Multiply the n-limb value a by the single limb b into r.
+// @return the limb carried out of the top of the product
+static std::uint32_t mul_1_scalar(std::uint32_t* r, const std::uint32_t* a,
+	std::size_t n, std::uint32_t b) {
+
+	std::uint64_t carry = 0;
+	for (std::size_t i = 0; i < n; ++i) {
+		carry += std::uint64_t(a[i]) * b;
+		r[i] = std::uint32_t(carry);
+		carry >>= 32;
+	}
+	return std::uint32_t(carry);
+}
+
+// Add the product of the n-limb value a and the single limb b to r. This
+// multiply-accumulate step is the inner loop of schoolbook multiplication and
+// of Montgomery reduction.
+// @return the limb carried out of r[n - 1]
+static std::uint32_t addmul_1_scalar(std::uint32_t* r, const std::uint32_t* a,
+	std::size_t n, std::uint32_t b) {
+
+	std::uint64_t carry = 0;
+	for (std::size_t i = 0; i < n; ++i) {
+		carry += std::uint64_t(a[i]) * b + r[i];
+		r[i] = std::uint32_t(carry);
+		carry >>= 32;
+	}
+	return std::uint32_t(carry);
+}
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#include <cstring>
+#define INTEGER_HAVE_X86_KERNELS
+
+// Carry-lookahead addition, 8 limbs per step. The 8 limb sums are formed at
+// once, ignoring carries. Limb i then "generates" a carry if its sum wrapped
+// around, and "propagates" an incoming carry if its sum is 0xFFFFFFFF. With
+// these as bit masks G and P, the carries into the limbs are
+//   ((G << 1 | carry_in) + P) ^ P,
+// since the addition ripples a carry through exactly the runs of propagating
+// limbs. This leaves a single short scalar step per 8 limbs.
+__attribute__((target("avx2")))
+static std::uint32_t add_n_avx2(std::uint32_t* r, const std::uint32_t* a,
+	const std::uint32_t* b, std::size_t n, std::uint32_t carry_in) {
+
+	const __m256i bias = _mm256_set1_epi32(int(0x80000000u));
+	const __m256i ones = _mm256_set1_epi32(-1);
+	const __m256i lane_shifts = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	const __m256i low_bit = _mm256_set1_epi32(1);
+
+	std::uint32_t carry = carry_in;
+	std::size_t i = 0;
+
+	for (; i + 8 <= n; i += 8) {
+		__m256i va = _mm256_loadu_si256((const __m256i*)(a + i));
+		__m256i vb = _mm256_loadu_si256((const __m256i*)(b + i));
+		__m256i sum = _mm256_add_epi32(va, vb);
+
+		// Unsigned sum < a, via a signed comparison of biased values
+		__m256i gen = _mm256_cmpgt_epi32(_mm256_xor_si256(va, bias),
+			_mm256_xor_si256(sum, bias));
+		__m256i prop = _mm256_cmpeq_epi32(sum, ones);
+
+		std::uint32_t G = _mm256_movemask_ps(_mm256_castsi256_ps(gen));
+		std::uint32_t P = _mm256_movemask_ps(_mm256_castsi256_ps(prop));
+		std::uint32_t carries = (((G << 1) | carry) + P) ^ P;
+
+		__m256i vc = _mm256_and_si256(
+			_mm256_srlv_epi32(_mm256_set1_epi32(int(carries)), lane_shifts), low_bit);
+		_mm256_storeu_si256((__m256i*)(r + i), _mm256_add_epi32(sum, vc));
+
+		carry = (carries >> 8) & 1;
+	}
+
+	return add_n_scalar(r + i, a + i, b + i, n - i, carry);
+}
+
+// Borrow-lookahead subtraction: as in add_n_avx2, with limb i generating a
+// borrow if a[i] < b[i] and propagating one if a[i] - b[i] = 0.
+__attribute__((target("avx2")))
+static std::uint32_t sub_n_avx2(std::uint32_t* r, const std::uint32_t* a,
+	const std::uint32_t* b, std::size_t n, std::uint32_t borrow_in) {
+
+	const __m256i bias = _mm256_set1_epi32(int(0x80000000u));
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i lane_shifts = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	const __m256i low_bit = _mm256_set1_epi32(1);
+
+	std::uint32_t borrow = borrow_in;
+	std::size_t i = 0;
+
+	for (; i + 8 <= n; i += 8) {
+		__m256i va = _mm256_loadu_si256((const __m256i*)(a + i));
+		__m256i vb = _mm256_loadu_si256((const __m256i*)(b + i));
+		__m256i diff = _mm256_sub_epi32(va, vb);
+
+		__m256i gen = _mm256_cmpgt_epi32(_mm256_xor_si256(vb, bias),
+			_mm256_xor_si256(va, bias));
+		__m256i prop = _mm256_cmpeq_epi32(diff, zero);
+
+		std::uint32_t G = _mm256_movemask_ps(_mm256_castsi256_ps(gen));
+		std::uint32_t P = _mm256_movemask_ps(_mm256_castsi256_ps(prop));
+		std::uint32_t borrows = (((G << 1) | borrow) + P) ^ P;
+
+		__m256i vc = _mm256_and_si256(
+			_mm256_srlv_epi32(_mm256_set1_epi32(int(borrows)), lane_shifts), low_bit);
+		_mm256_storeu_si256((__m256i*)(r + i), _mm256_sub_epi32(diff, vc));
+
+		borrow = (borrows >> 8) & 1;
+	}
+
+	return sub_n_scalar(r + i, a + i, b + i, n - i, borrow);
+}
+
+// The kernels of the bmi2 set treat each pair of 32-bit limbs as one 64-bit
+// word (limbs are stored least significant first, as is x86 memory), which
+// halves the length of the carry chains. Addition and subtraction have a
+// single carry chain, which runs through four words per step: within a step
+// the compiler keeps the carry in the carry flag (adc/sbb), and only between
+// steps does it go through a register.
+static std::uint32_t add_n_64(std::uint32_t* r, const std::uint32_t* a,
+	const std::uint32_t* b, std::size_t n, std::uint32_t carry_in) {
+
+	unsigned char carry = carry_in;
+	std::size_t i = 0;
+
+	// Both inputs are loaded before r is written, so r may be a or b.
+	for (; i + 8 <= n; i += 8) {
+		unsigned long long x0, x1, x2, x3, y0, y1, y2, y3;
+		std::memcpy(&x0, a + i, 8);
+		std::memcpy(&x1, a + i + 2, 8);
+		std::memcpy(&x2, a + i + 4, 8);
+		std::memcpy(&x3, a + i + 6, 8);
+		std::memcpy(&y0, b + i, 8);
+		std::memcpy(&y1, b + i + 2, 8);
+		std::memcpy(&y2, b + i + 4, 8);
+		std::memcpy(&y3, b + i + 6, 8);
+		carry = _addcarry_u64(carry, x0, y0, &x0);
+		carry = _addcarry_u64(carry, x1, y1, &x1);
+		carry = _addcarry_u64(carry, x2, y2, &x2);
+		carry = _addcarry_u64(carry, x3, y3, &x3);
+		std::memcpy(r + i, &x0, 8);
+		std::memcpy(r + i + 2, &x1, 8);
+		std::memcpy(r + i + 4, &x2, 8);
+		std::memcpy(r + i + 6, &x3, 8);
+	}
+
+	for (; i + 2 <= n; i += 2) {
+		unsigned long long x, y;
+		std::memcpy(&x, a + i, 8);
+		std::memcpy(&y, b + i, 8);
+		carry = _addcarry_u64(carry, x, y, &x);
+		std::memcpy(r + i, &x, 8);
+	}
+
+	return add_n_scalar(r + i, a + i, b + i, n - i, carry);
+}
+
+static std::uint32_t sub_n_64(std::uint32_t* r, const std::uint32_t* a,
+	const std::uint32_t* b, std::size_t n, std::uint32_t borrow_in) {
+
+	unsigned char borrow = borrow_in;
+	std::size_t i = 0;
+
+	for (; i + 8 <= n; i += 8) {
+		unsigned long long x0, x1, x2, x3, y0, y1, y2, y3;
+		std::memcpy(&x0, a + i, 8);
+		std::memcpy(&x1, a + i + 2, 8);
+		std::memcpy(&x2, a + i + 4, 8);
+		std::memcpy(&x3, a + i + 6, 8);
+		std::memcpy(&y0, b + i, 8);
+		std::memcpy(&y1, b + i + 2, 8);
+		std::memcpy(&y2, b + i + 4, 8);
+		std::memcpy(&y3, b + i + 6, 8);
+		borrow = _subborrow_u64(borrow, x0, y0, &x0);
+		borrow = _subborrow_u64(borrow, x1, y1, &x1);
+		borrow = _subborrow_u64(borrow, x2, y2, &x2);
+		borrow = _subborrow_u64(borrow, x3, y3, &x3);
+		std::memcpy(r + i, &x0, 8);
+		std::memcpy(r + i + 2, &x1, 8);
+		std::memcpy(r + i + 4, &x2, 8);
+		std::memcpy(r + i + 6, &x3, 8);
+	}
+
+	for (; i + 2 <= n; i += 2) {
+		unsigned long long x, y;
+		std::memcpy(&x, a + i, 8);
+		std::memcpy(&y, b + i, 8);
+		borrow = _subborrow_u64(borrow, x, y, &x);
+		std::memcpy(r + i, &x, 8);
+	}
+
+	return sub_n_scalar(r + i, a + i, b + i, n - i, borrow);
+}
+
+__attribute__((target("bmi2,adx")))
+static std::uint32_t mul_1_bmi2(std::uint32_t* r, const std::uint32_t* a,
+	std::size_t n, std::uint32_t b) {
+
+	// A 64-bit word times a 32-bit limb fits in 96 bits, so the carry word
+	// always stays below 2^32.
+	unsigned long long carry = 0;
+	std::size_t i = 0;
+
+	for (; i + 2 <= n; i += 2) {
+		unsigned long long x, hi;
+		std::memcpy(&x, a + i, 8);
+		unsigned long long lo = _mulx_u64(x, b, &hi);
+		hi += _addcarryx_u64(0, lo, carry, &lo);
+		std::memcpy(r + i, &lo, 8);
+		carry = hi;
+	}
+
+	if (i < n) {
+		carry += std::uint64_t(a[i]) * b;
+		r[i] = std::uint32_t(carry);
+		carry >>= 32;
+	}
+
+	return std::uint32_t(carry);
+}
+
+// Adding the product a * b to r takes two carry chains per word: one adds
+// the high half of the previous word's product to the low half of this one,
+// the other adds r. Each chain keeps its own carry bit from word to word
+// (only the final one is folded into the returned limb), so neither waits on
+// the other. These are the two chains adcx and adox were made for; GCC
+// compiles both to adc and keeps each carry in a byte register between
+// words, but the two chains still overlap in the pipeline.
+__attribute__((target("bmi2,adx")))
+static std::uint32_t addmul_1_bmi2(std::uint32_t* r, const std::uint32_t* a,
+	std::size_t n, std::uint32_t b) {
+
+	// The high half of a 64-bit word times a 32-bit limb is below 2^32 - 1,
+	// so hi + c1 + c2 cannot overflow.
+	unsigned long long hi = 0;
+	unsigned char c1 = 0, c2 = 0;
+	std::size_t i = 0;
+
+	for (; i + 2 <= n; i += 2) {
+		unsigned long long x, y, next_hi;
+		std::memcpy(&x, a + i, 8);
+		std::memcpy(&y, r + i, 8);
+		unsigned long long lo = _mulx_u64(x, b, &next_hi);
+		c1 = _addcarryx_u64(c1, lo, hi, &lo);
+		c2 = _addcarryx_u64(c2, lo, y, &lo);
+		std::memcpy(r + i, &lo, 8);
+		hi = next_hi;
+	}
+
+	unsigned long long carry = hi + c1 + c2;
+	if (i < n) {
+		carry += std::uint64_t(a[i]) * b + r[i];
+		r[i] = std::uint32_t(carry);
+		carry >>= 32;
+	}
+
+	return std::uint32_t(carry);
+}
+#endif
+
+typedef std::uint32_t (*CarryKernel)(std::uint32_t*, const std::uint32_t*,
+	const std::uint32_t*, std::size_t, std::uint32_t);
+typedef std::uint32_t (*MulKernel)(std::uint32_t*, const std::uint32_t*,
+	std::size_t, std::uint32_t);
+
+// A set of implementations of the innermost limb loops. Everything that works
+// on limbs goes through the active set, which is chosen on first use (the
+// first supported set in kernel_sets) and can be overridden by force_kernels.
+struct KernelSet {
+	const char* name;
+	bool (*supported)();
+	CarryKernel add_n;
+	CarryKernel sub_n;
+	MulKernel mul_1;
+	MulKernel addmul_1;
+};
+
+static bool always_supported() {
+	return true;
+}
+
+#ifdef INTEGER_HAVE_X86_KERNELS
+static bool cpu_has_bmi2_adx() {
+	return __builtin_cpu_supports("bmi2") && __builtin_cpu_supports("adx");
+}
+
+static bool cpu_has_avx2() {
+	return __builtin_cpu_supports("avx2");
+}
+#endif
+
+// Kernel sets, from most to least preferred
+static const KernelSet kernel_sets[] = {
+#ifdef INTEGER_HAVE_X86_KERNELS
+	{ "bmi2", cpu_has_bmi2_adx, add_n_64, sub_n_64, mul_1_bmi2, addmul_1_bmi2 },
+	{ "avx2", cpu_has_avx2, add_n_avx2, sub_n_avx2, mul_1_scalar, addmul_1_scalar },
+#endif
+	{ "generic", always_supported, add_n_scalar, sub_n_scalar, mul_1_scalar,
+		addmul_1_scalar }
+};
+
+static const std::size_t num_kernel_sets = sizeof(kernel_sets) / sizeof(kernel_sets[0]);
+
+static const KernelSet* select_kernels() {
+	for (std::size_t i = 0; i < num_kernel_sets; ++i) {
+		if (kernel_sets[i].supported()) {
+			return &kernel_sets[i];
+		}
+	}
+	return &kernel_sets[num_kernel_sets - 1];
+}
+
+// The active kernel set. It is chosen on first use rather than by a global
+// initializer, which could run after other static initializers had already
+// used the library, and it is atomic so that force_kernels may switch it
+// while other threads are multiplying. (The sets themselves are constants,
+// so relaxed loads are enough.)
+static std::atomic<const KernelSet*>& active_kernel_set() {
+	static std::atomic<const KernelSet*> active(select_kernels());
+	return active;
+}
+
+static const KernelSet* kernels() {
+	return active_kernel_set().load(std::memory_order_relaxed);
+}
+
+bool force_kernels(const std::string& name) {
+	for (std::size_t i = 0; i < num_kernel_sets; ++i) {
+		if (name == kernel_sets[i].name && kernel_sets[i].supported()) {
+			active_kernel_set().store(&kernel_sets[i], std::memory_order_relaxed);
+			return true;
+		}
+	}
+	return false;
+}
+
+std::string active_kernels() {
+	return kernels()->name;
+}
+
+static Limbs add(const Limbs& a, const Limbs& b) {
+	const Limbs& longer = (a.size() >= b.size()) ? a : b;
+	const Limbs& shorter = (a.size() >= b.size()) ? b : a;
+
+	Limbs sum(longer.size() + 1, 0);
+	std::uint32_t carry = kernels()->add_n(&sum[0], longer.data(), shorter.data(),
+		shorter.size(), 0);
+
+	// Ripple the carry through the rest of the longer value.
+	for (std::size_t i = shorter.size(); i < longer.size(); ++i) {
+		sum[i] = longer[i] + carry;
+		carry = (carry && sum[i] == 0) ? 1 : 0;
+	}
+	sum[longer.size()] = carry;
+
+	trim(sum);
+	return sum;
+}
+
+// Compute a - b. Requires a >= b.
+static Limbs sub(const Limbs& a, const Limbs& b) {
+	if (b.empty()) {
+		return a;
+	}
+
+	Limbs diff(a.size(), 0);
+	std::uint32_t borrow = kernels()->sub_n(&diff[0], a.data(), b.data(), b.size(), 0);
+
+	for (std::size_t i = b.size(); i < a.size(); ++i) {
+		diff[i] = a[i] - borrow;
+		borrow = (borrow && a[i] == 0) ? 1 : 0;
+	}
+
+	trim(diff);
+	return diff;
+}
+
+// The multi-level algorithms below (Karatsuba multiplication, long
+// division, decimal conversion and its table of powers, Lehmer's gcd, the
+// Newton iteration for roots and product trees) take their temporary buffers
+// from a per-thread stack of scratch words instead of allocating vectors at
+// every level or step. A top-level call works out how much scratch it needs
+// from the operand sizes and reserves it with a ScratchFrame; the algorithm
+// then carves that region up by hand. The stack keeps its memory for the
+// lifetime of the thread, so once it has grown to the largest request these
+// algorithms allocate only their results (and the limb vectors that carry
+// values to and from Integer).
+class ScratchStack {
+public:
+	ScratchStack() : block_(0), used_(0), total_(0) {}
+
+	// Take n words from the top of the stack.
+	std::uint32_t* take(std::size_t n) {
+		if (n == 0) {
+			return nullptr;
+		}
+
+		while (block_ < blocks_.size()) {
+			if (used_ + n <= sizes_[block_]) {
+				std::uint32_t* words = blocks_[block_].get() + used_;
+				used_ += n;
+				return words;
+			}
+
+			++block_;
+			used_ = 0;
+		}
+
+		// Out of room: add a block at least as large as all the others
+		// together, so the stack only grows a logarithmic number of times.
+		std::size_t size = std::max(n, total_);
+		blocks_.push_back(std::unique_ptr<std::uint32_t[]>(new std::uint32_t[size]));
+		sizes_.push_back(size);
+		total_ += size;
+
+		block_ = blocks_.size() - 1;
+		used_ = n;
+		return blocks_.back().get();
+	}
+
+private:
+	// Blocks are never moved or freed, so words handed out stay valid.
+	std::vector<std::unique_ptr<std::uint32_t[]> > blocks_;
+	std::vector<std::size_t> sizes_;
+
+	// The block currently being taken from, and how many of its words are
+	// in use.
+	std::size_t block_;
+	std::size_t used_;
+
+	// The number of words in all blocks.
+	std::size_t total_;
+
+	friend class ScratchFrame;
+};
+
+static thread_local ScratchStack scratch_stack;
+
+// Words taken from the calling thread's scratch stack for the lifetime of
+// the frame. Frames must be destroyed in the reverse order of creation,
+// which scoping guarantees.
+class ScratchFrame {
+public:
+	explicit ScratchFrame(std::size_t n)
+		: block_(scratch_stack.block_), used_(scratch_stack.used_),
+		words_(scratch_stack.take(n)) {}
+
+	~ScratchFrame() {
+		scratch_stack.block_ = block_;
+		scratch_stack.used_ = used_;
+	}
+
+	inline std::uint32_t* data() const { return words_; }
+
+private:
+	std::size_t block_;
+	std::size_t used_;
+	std::uint32_t* words_;
+};
+
+// Add x[0, xn) into r[0, rn) (rn >= xn), carrying through the rest of r. The
+// caller guarantees that the sum fits in rn limbs.
+static void add_into(std::uint32_t* r, std::size_t rn, const std::uint32_t* x, std::size_t xn) {
+	std::uint32_t carry = kernels()->add_n(r, r, x, xn, 0);
+	for (std::size_t i = xn; carry != 0 && i < rn; ++i) {
+		r[i] += carry;
+		carry = (r[i] == 0) ? 1 : 0;
+	}
+}
+
+// Subtract x[0, xn) from r[0, rn) (rn >= xn), borrowing from the rest of r.
+// The caller guarantees that the difference is not negative.
+static void sub_from(std::uint32_t* r, std::size_t rn, const std::uint32_t* x, std::size_t xn) {
+	std::uint32_t borrow = kernels()->sub_n(r, r, x, xn, 0);
+	for (std::size_t i = xn; borrow != 0 && i < rn; ++i) {
+		borrow = (r[i] == 0) ? 1 : 0;
+		--r[i];
+	}
+}
+
+// The number of limbs in a[0, n) without its most significant zero limbs.
+static std::size_t trimmed_length(const std::uint32_t* a, std::size_t n) {
+	while (n > 0 && a[n - 1] == 0) {
+		--n;
+	}
+	return n;
+}
+
+// Compare a[0, an) with b[0, bn), neither of which has a zero top limb.
+// @return -1, 0 or 1 if a is less than, equal to or greater than b.
+static int compare_n(const std::uint32_t* a, std::size_t an, const std::uint32_t* b,
+	std::size_t bn) {
+
+	if (an != bn) {
+		return (an < bn) ? -1 : 1;
+	}
+
+	for (std::size_t i = an; i-- > 0; ) {
+		if (a[i] != b[i]) {
+			return (a[i] < b[i]) ? -1 : 1;
+		}
+	}
+
+	return 0;
+}
+
+// Schoolbook multiplication of a[0, na) by b[0, nb) (na >= nb >= 1) into
+// r[0, na + nb).
+static void mul_basecase(std::uint32_t* r, const std::uint32_t* a, std::size_t na,
+	const std::uint32_t* b, std::size_t nb) {
+
+	r[na] = kernels()->mul_1(r, a, na, b[0]);
+	for (std::size_t i = 1; i < nb; ++i) {
+		r[i + na] = kernels()->addmul_1(r + i, a, na, b[i]);
+	}
+}
+
+// Below this many limbs (in the shorter operand), schoolbook multiplication
+// is faster than Karatsuba's method. The value was chosen with the mul table
+// of hw-03-bench, built with INTEGER_KARATSUBA_THRESHOLD from 16 to 128:
+// products of 256 to 4096 limbs took the same time (within noise) for any
+// threshold from 32 to 64, while 16 was 1.5 to 2 times slower at 2048 and
+// 4096 limbs and 128 was 10 to 20% slower.
+#ifndef INTEGER_KARATSUBA_THRESHOLD
+#define INTEGER_KARATSUBA_THRESHOLD 32
+#endif
+static const std::size_t karatsuba_threshold = INTEGER_KARATSUBA_THRESHOLD;
+
+// Settings for the multi-threaded algorithms; see set_max_threads and
+// set_parallel_cutoff. In the threads table of hw-03-bench, each thread a
+// product starts costs about 30 us, and at the default cutoff the smallest
+// piece handed to a thread (a product of two 32768-bit halves) takes about
+// 0.4 ms, so starting the thread costs under a tenth of the work it takes.
+static std::atomic<unsigned int> thread_cap(0);
+static std::atomic<unsigned int> parallel_cutoff_bits(1 << 16);
+
+void set_max_threads(unsigned int num_threads) {
+	thread_cap = num_threads;
+}
+
+unsigned int max_threads() {
+	unsigned int num_threads = thread_cap;
+	if (num_threads == 0) {
+		num_threads = std::thread::hardware_concurrency();
+	}
+	return (num_threads == 0) ? 1 : num_threads;
+}
+
+// The number of threads (including itself) the calling thread may use; 0
+// outside of the library's parallel work, where max_threads() applies. Work
+// handed to other threads takes its share out of this budget, so a large
+// product computed inside parallel_product, say, does not start max_threads()
+// more threads of its own on every worker.
+static thread_local unsigned int thread_budget = 0;
+
+// Set the calling thread's budget for the lifetime of the object.
+class ThreadBudget {
+public:
+	explicit ThreadBudget(unsigned int num_threads) : previous_(thread_budget) {
+		thread_budget = num_threads;
+	}
+
+	~ThreadBudget() {
+		thread_budget = previous_;
+	}
+
+private:
+	unsigned int previous_;
+};
+
+static unsigned int available_threads() {
+	return (thread_budget != 0) ? thread_budget : max_threads();
+}
+
+void set_parallel_cutoff(unsigned int num_bits) {
+	parallel_cutoff_bits = num_bits;
+}
+
+// Add b * 2^(32 * offset) to the (large enough) accumulator r in place.
+static void add_at(Limbs& r, const Limbs& b, std::size_t offset) {
+	add_into(&r[offset], r.size() - offset, b.data(), b.size());
+}
+
+// Store |x - y| in d[0, yn) and return true if x < y, where x = x[0, xn) and
+// y = y[0, yn) with xn <= yn.
+static bool abs_diff(std::uint32_t* d, const std::uint32_t* x, std::size_t xn,
+	const std::uint32_t* y, std::size_t yn) {
+
+	std::copy(x, x + xn, d);
+	std::fill(d + xn, d + yn, 0);
+
+	std::size_t i = yn;
+	while (i > 0 && d[i - 1] == y[i - 1]) {
+		--i;
+	}
+
+	if (i == 0 || d[i - 1] > y[i - 1]) {
+		kernels()->sub_n(d, d, y, yn, 0);
+		return false;
+	}
+
+	kernels()->sub_n(d, y, d, yn, 0);
+	return true;
+}
+
+// The number of scratch words karatsuba needs for n-limb operands.
+static std::size_t karatsuba_scratch(std::size_t n) {
+	if (n < karatsuba_threshold) {
+		return 0;
+	}
+
+	std::size_t hi = n - n / 2;
+	return 6 * hi + 1 + karatsuba_scratch(hi);
+}
+
+static void karatsuba(std::uint32_t* r, const std::uint32_t* a, const std::uint32_t* b,
+	std::size_t n, std::uint32_t* scratch, unsigned int num_threads);
+
+// Run karatsuba with scratch from the calling thread's own stack (used by
+// the threads that karatsuba starts).
+static void karatsuba_on_thread(std::uint32_t* r, const std::uint32_t* a,
+	const std::uint32_t* b, std::size_t n, unsigned int num_threads) {
+
+	ScratchFrame frame(karatsuba_scratch(n));
+	karatsuba(r, a, b, n, frame.data(), num_threads);
+}
+
+// Karatsuba multiplication of the n-limb values a and b into r[0, 2n).
+// Splitting a = a1 B + a0 and b = b1 B + b0 (with B = 2^(32 lo), lo = n / 2),
+// the product needs only three half-size products:
+//   a b = z2 B^2 + (z0 + z2 - (a0 - a1)(b0 - b1)) B + z0,
+// where z0 = a0 b0 and z2 = a1 b1. z0 and z2 are computed straight into the
+// two halves of r, and |a0 - a1| |b0 - b1| in scratch, which must hold
+// karatsuba_scratch(n) words. The three products are independent, so above
+// the parallel cutoff they are spread over the num_threads threads available
+// (counting the calling thread): with three or more, z0 and z2 each get a
+// third of them on a new thread (with its own scratch) and the calling thread
+// keeps the rest for the difference; with two, only z2 gets a new thread.
+static void karatsuba(std::uint32_t* r, const std::uint32_t* a, const std::uint32_t* b,
+	std::size_t n, std::uint32_t* scratch, unsigned int num_threads) {
+
+	if (n < karatsuba_threshold) {
+		mul_basecase(r, a, n, b, n);
+		return;
+	}
+
+	std::size_t lo = n / 2;
+	std::size_t hi = n - lo;
+
+	std::uint32_t* a_diff = scratch;
+	std::uint32_t* b_diff = a_diff + hi;
+	std::uint32_t* diff_product = b_diff + hi;
+	std::uint32_t* middle = diff_product + 2 * hi;
+	std::uint32_t* rest = middle + 2 * hi + 1;
+
+	bool a_negative = abs_diff(a_diff, a, lo, a + lo, hi);
+	bool b_negative = abs_diff(b_diff, b, lo, b + lo, hi);
+
+	bool parallel = 32 * n >= parallel_cutoff_bits;
+	if (parallel && num_threads >= 3) {
+		unsigned int sub_threads = num_threads / 3;
+		std::thread worker0(karatsuba_on_thread, r, a, b, lo, sub_threads);
+		std::thread worker2(karatsuba_on_thread, r + 2 * lo, a + lo, b + lo, hi, sub_threads);
+		karatsuba(diff_product, a_diff, b_diff, hi, rest, num_threads - 2 * sub_threads);
+		worker0.join();
+		worker2.join();
+	}
+	else if (parallel && num_threads == 2) {
+		std::thread worker2(karatsuba_on_thread, r + 2 * lo, a + lo, b + lo, hi, 1);
+		karatsuba(r, a, b, lo, rest, 1);
+		karatsuba(diff_product, a_diff, b_diff, hi, rest, 1);
+		worker2.join();
+	}
+	else {
+		karatsuba(r, a, b, lo, rest, 1);
+		karatsuba(r + 2 * lo, a + lo, b + lo, hi, rest, 1);
+		karatsuba(diff_product, a_diff, b_diff, hi, rest, 1);
+	}
+
+	// middle = z0 + z2 -+ (a0 - a1)(b0 - b1)
+	std::copy(r + 2 * lo, r + 2 * n, middle);
+	middle[2 * hi] = 0;
+	add_into(middle, 2 * hi + 1, r, 2 * lo);
+
+	if (a_negative == b_negative) {
+		sub_from(middle, 2 * hi + 1, diff_product, 2 * hi);
+	}
+	else {
+		add_into(middle, 2 * hi + 1, diff_product, 2 * hi);
+	}
+
+	// The middle term is below 2^(32 (n + 1)), so its top limbs past the end
+	// of r are zero.
+	add_into(r + lo, 2 * n - lo, middle, std::min(2 * hi + 1, 2 * n - lo));
+}
+
+// The number of scratch words mul_unbalanced needs when na >= nb.
+static std::size_t mul_scratch(std::size_t na, std::size_t nb) {
+	if (nb < karatsuba_threshold) {
+		return 0;
+	}
+
+	std::size_t need = 2 * nb + karatsuba_scratch(nb);
+	std::size_t tail = na % nb;
+	if (tail >= karatsuba_threshold) {
+		need = std::max(need, nb + tail + mul_scratch(nb, tail));
+	}
+
+	return need;
+}
+
+// Multiply a[0, na) by b[0, nb) (na >= nb >= 1) into r[0, na + nb). The
+// longer operand is cut into nb-limb pieces, each multiplied by b with
+// Karatsuba's method; a shorter last piece is handled recursively.
+static void mul_unbalanced(std::uint32_t* r, const std::uint32_t* a, std::size_t na,
+	const std::uint32_t* b, std::size_t nb, std::uint32_t* scratch,
+	unsigned int num_threads) {
+
+	if (nb < karatsuba_threshold) {
+		mul_basecase(r, a, na, b, nb);
+		return;
+	}
+
+	if (na == nb) {
+		karatsuba(r, a, b, nb, scratch, num_threads);
+		return;
+	}
+
+	std::fill(r, r + na + nb, 0);
+
+	std::uint32_t* piece = scratch;
+	std::size_t offset = 0;
+	for (; offset + nb <= na; offset += nb) {
+		karatsuba(piece, a + offset, b, nb, piece + 2 * nb, num_threads);
+		add_into(r + offset, na + nb - offset, piece, 2 * nb);
+	}
+
+	std::size_t tail = na - offset;
+	if (tail == 0) {
+		return;
+	}
+
+	if (tail < karatsuba_threshold) {
+		for (std::size_t i = 0; i < tail; ++i) {
+			std::uint32_t carry = kernels()->addmul_1(r + offset + i, b, nb, a[offset + i]);
+			add_into(r + offset + i + nb, na - offset - i, &carry, 1);
+		}
+		return;
+	}
+
+	mul_unbalanced(piece, b, nb, a + offset, tail, piece + nb + tail, num_threads);
+	add_into(r + offset, na + nb - offset, piece, nb + tail);
+}
+
+// Multiply a[0, na) by b[0, nb) (na, nb >= 1) into r[0, na + nb), with
+// scratch from the calling thread's stack.
+static void mul_n(std::uint32_t* r, const std::uint32_t* a, std::size_t na,
+	const std::uint32_t* b, std::size_t nb) {
+
+	if (na < nb) {
+		std::swap(a, b);
+		std::swap(na, nb);
+	}
+
+	unsigned int num_threads = 1;
+	if (32 * nb >= parallel_cutoff_bits) {
+		num_threads = available_threads();
+	}
+
+	ScratchFrame frame(mul_scratch(na, nb));
+	mul_unbalanced(r, a, na, b, nb, frame.data(), num_threads);
+}
+
+static Limbs mul(const Limbs& a, const Limbs& b) {
+	if (a.empty() || b.empty()) {
+		return Limbs();
+	}
+
+	Limbs prod(a.size() + b.size());
+	mul_n(prod.data(), a.data(), a.size(), b.data(), b.size());
+
+	trim(prod);
+	return prod;
+}
+
+// Shift a left by num_bits bits (multiply by 2^num_bits).
+static Limbs shift_left(const Limbs& a, unsigned int num_bits) {
+	if (a.empty()) {
+		return a;
+	}
+
+	unsigned int limb_shift = num_bits / 32;
+	unsigned int bit_shift = num_bits % 32;
+
+	Limbs shifted(a.size() + limb_shift + 1, 0);
+	for (std::size_t i = 0; i < a.size(); ++i) {
+		std::uint64_t t = std::uint64_t(a[i]) << bit_shift;
+		shifted[i + limb_shift] |= std::uint32_t(t);
+		shifted[i + limb_shift + 1] |= std::uint32_t(t >> 32);
+	}
+
+	trim(shifted);
+	return shifted;
+}
+
+// Shift a right by num_bits bits (divide by 2^num_bits).
+static Limbs shift_right(const Limbs& a, unsigned int num_bits) {
+	unsigned int limb_shift = num_bits / 32;
+	unsigned int bit_shift = num_bits % 32;
+
+	if (limb_shift >= a.size()) {
+		return Limbs();
+	}
+
+	Limbs shifted(a.size() - limb_shift, 0);
+	for (std::size_t i = 0; i < shifted.size(); ++i) {
+		std::uint64_t t = a[i + limb_shift];
+		if (i + limb_shift + 1 < a.size()) {
+			t |= std::uint64_t(a[i + limb_shift + 1]) << 32;
+		}
+		shifted[i] = std::uint32_t(t >> bit_shift);
+	}
+
+	trim(shifted);
+	return shifted;
+}
+
+// Shift x[0, n) left by s < 32 bits into r[0, n) and return the bits shifted
+// out of the top limb.
+static std::uint32_t shift_left_n(std::uint32_t* r, const std::uint32_t* x,
+	std::size_t n, unsigned int s) {
+
+	if (s == 0) {
+		std::copy(x, x + n, r);
+		return 0;
+	}
+
+	std::uint32_t out = x[n - 1] >> (32 - s);
+	for (std::size_t i = n - 1; i > 0; --i) {
+		r[i] = (x[i] << s) | (x[i - 1] >> (32 - s));
+	}
+	r[0] = x[0] << s;
+
+	return out;
+}
+
+// Long division (Knuth's Algorithm D) of u[0, un) by v[0, vn), where
+// un >= vn >= 2 and the top limb of v is not zero. The quotient is written to
+// q[0, un - vn + 1) and the remainder to r[0, vn); r may be the same as u,
+// but q must not overlap either. scratch must hold un + vn + 1 words.
+static void divmod_n(std::uint32_t* q, std::uint32_t* r, const std::uint32_t* u_in,
+	std::size_t un, const std::uint32_t* v_in, std::size_t vn, std::uint32_t* scratch) {
+
+	// Normalize so that the top bit of the divisor is set. This keeps the
+	// estimated quotient digits within 2 of the true ones.
+	unsigned int s = 0;
+	for (std::uint32_t top = v_in[vn - 1]; !(top & 0x80000000u); top <<= 1) {
+		++s;
+	}
+
+	std::uint32_t* u = scratch;
+	std::uint32_t* v = u + un + 1;
+	u[un] = shift_left_n(u, u_in, un, s);
+	shift_left_n(v, v_in, vn, s);
+
+	int n = vn;
+	int m = un - vn;
+
+	const std::uint64_t base = std::uint64_t(1) << 32;
+
+	for (int j = m; j >= 0; --j) {
+		std::uint64_t num = (std::uint64_t(u[j + n]) << 32) | u[j + n - 1];
+		std::uint64_t qhat = num / v[n - 1];
+		std::uint64_t rhat = num % v[n - 1];
+
+		while (qhat >= base
+			|| qhat * v[n - 2] > ((rhat << 32) | u[j + n - 2])) {
+			--qhat;
+			rhat += v[n - 1];
+			if (rhat >= base) {
+				break;
+			}
+		}
+
+		// Multiply and subtract qhat * v from the current window of u.
+		std::int64_t k = 0;
+		std::int64_t t;
+		for (int i = 0; i < n; ++i) {
+			std::uint64_t p = qhat * v[i];
+			t = std::int64_t(u[i + j]) - k - std::int64_t(p & 0xFFFFFFFFu);
+			u[i + j] = std::uint32_t(t);
+			k = std::int64_t(p >> 32) - (t >> 32);
+		}
+		t = std::int64_t(u[j + n]) - k;
+		u[j + n] = std::uint32_t(t);
+
+		q[j] = std::uint32_t(qhat);
+
+		// qhat was one too large, so add v back.
+		if (t < 0) {
+			--q[j];
+			u[j + n] += kernels()->add_n(u + j, u + j, v, n, 0);
+		}
+	}
+
+	// Undo the normalization of the remainder.
+	for (int i = 0; i < n; ++i) {
+		r[i] = (s == 0) ? u[i] : (u[i] >> s) | (u[i + 1] << (32 - s));
+	}
+}
+
+// Divide a[0, n) by the non-zero word d in place and return the remainder.
+static std::uint32_t divmod_1(std::uint32_t* a, std::size_t n, std::uint32_t d) {
+	std::uint64_t rem = 0;
+
+	for (std::size_t i = n; i-- > 0; ) {
+		std::uint64_t cur = (rem << 32) | a[i];
+		a[i] = std::uint32_t(cur / d);
+		rem = cur % d;
+	}
+
+	return std::uint32_t(rem);
+}
+
+// Divide u[0, un) by v[0, vn) in place, where un >= vn >= 1 and neither has a
+// zero top limb: the quotient is written to q[0, un - vn + 1) and the
+// remainder replaces u[0, vn). q must not overlap u or v.
+static void divmod_in_place(std::uint32_t* q, std::uint32_t* u, std::size_t un,
+	const std::uint32_t* v, std::size_t vn) {
+
+	if (vn == 1) {
+		std::copy(u, u + un, q);
+		u[0] = divmod_1(q, un, v[0]);
+		return;
+	}
+
+	ScratchFrame frame(un + vn + 1);
+	divmod_n(q, u, u, un, v, vn, frame.data());
+}
+
+// Reduce u[0, un) modulo v[0, vn) in place, where v has no zero top limb.
+// @return the length of the (trimmed) remainder in u
+static std::size_t mod_in_place(std::uint32_t* u, std::size_t un, const std::uint32_t* v,
+	std::size_t vn) {
+
+	un = trimmed_length(u, un);
+	if (compare_n(u, un, v, vn) < 0) {
+		return un;
+	}
+
+	ScratchFrame quotient(un - vn + 1);
+	divmod_in_place(quotient.data(), u, un, v, vn);
+	return trimmed_length(u, vn);
+}
+
+// Long division of a by a non-zero b. The quotient is stored in q and the
+// remainder in r.
+static void divmod(const Limbs& a, const Limbs& b, Limbs& q, Limbs& r) {
+	if (compare(a, b) < 0) {
+		q.clear();
+		r = a;
+		return;
+	}
+
+	// Dividing by a single limb only needs one pass.
+	if (b.size() == 1) {
+		q = a;
+		r.assign(1, divmod_1(q.data(), q.size(), b[0]));
+		trim(q);
+		trim(r);
+		return;
+	}
+
+	q.assign(a.size() - b.size() + 1, 0);
+	r.assign(b.size(), 0);
+
+	ScratchFrame frame(a.size() + b.size() + 1);
+	divmod_n(q.data(), r.data(), a.data(), a.size(), b.data(), b.size(), frame.data());
+
+	trim(q);
+	trim(r);
+}
+
+static Limbs mod(const Limbs& a, const Limbs& m) {
+	Limbs q, r;
+	divmod(a, m, q, r);
+	return r;
+}
+
+// Decimal digits are produced nine at a time, by dividing by 10^9.
+static const std::uint32_t decimal_base = 1000000000;
+static const std::size_t decimal_base_digits = 9;
+
+// Below this many limbs, write_decimal divides by 10^9 repeatedly instead of
+// splitting the value.
+static const std::size_t decimal_threshold = 32;
+
+// Values have fewer than 2^32 bits, so the powers 10^(9 * 2^i) that split
+// them stop well before this.
+static const std::size_t max_decimal_powers = 32;
+
+// A value on the scratch stack: data[0, size).
+struct LimbSpan {
+	const std::uint32_t* data;
+	std::size_t size;
+};
+
+// Write the decimal digits of a[0, n) into out[0, width), padded with leading
+// zeros, overwriting a. The caller guarantees that a < 10^width and that out
+// is filled with '0'.
+static void write_decimal_basecase(std::uint32_t* a, std::size_t n, char* out,
+	std::size_t width) {
+
+	char* digit = out + width;
+
+	while (n > 0 && a[n - 1] == 0) {
+		--n;
+	}
+
+	while (n > 0) {
+		std::uint32_t chunk = divmod_1(a, n, decimal_base);
+		if (a[n - 1] == 0) {
+			--n;
+		}
+
+		for (std::size_t i = 0; i < decimal_base_digits && digit > out; ++i) {
+			*--digit = char('0' + chunk % 10);
+			chunk /= 10;
+		}
+	}
+}
+
+// The number of scratch words write_decimal needs for an n-limb value at
+// level k. This never decreases as n grows, so it also covers the shorter
+// values met further down.
+static std::size_t decimal_scratch(const LimbSpan* powers, std::size_t k,
+	std::size_t n) {
+
+	if (k == 0 || n < decimal_threshold) {
+		return 0;
+	}
+
+	std::size_t vn = powers[k - 1].size;
+	if (n < vn) {
+		return decimal_scratch(powers, k - 1, n);
+	}
+
+	std::size_t qn = n - vn + 1;
+	return qn + std::max(n + vn + 1, decimal_scratch(powers, k - 1, std::max(qn, vn)));
+}
+
+static void write_decimal(std::uint32_t* a, std::size_t n, const LimbSpan* powers,
+	std::size_t k, char* out, std::uint32_t* scratch, unsigned int num_threads);
+
+// Run write_decimal with scratch from the calling thread's own stack (used
+// by the threads that write_decimal starts).
+static void write_decimal_on_thread(std::uint32_t* a, std::size_t n,
+	const LimbSpan* powers, std::size_t k, char* out, unsigned int num_threads) {
+
+	ScratchFrame frame(decimal_scratch(powers, k, n));
+	write_decimal(a, n, powers, k, out, frame.data(), num_threads);
+}
+
+// Write the decimal digits of a[0, n) < 10^(9 * 2^k) into out[0, 9 * 2^k),
+// overwriting a, where powers[i] = 10^(9 * 2^i). Dividing by powers[k - 1]
+// splits a into a high and a low half whose digits go to disjoint halves of
+// out: the quotient is kept at the bottom of scratch (which must hold
+// decimal_scratch(powers, k, n) words) and the remainder replaces a, so the
+// two halves can reuse the rest of scratch in turn. Above the parallel cutoff
+// the high half is written on a new thread instead.
+static void write_decimal(std::uint32_t* a, std::size_t n, const LimbSpan* powers,
+	std::size_t k, char* out, std::uint32_t* scratch, unsigned int num_threads) {
+
+	std::size_t width = decimal_base_digits << k;
+
+	while (n > 0 && a[n - 1] == 0) {
+		--n;
+	}
+
+	if (k == 0 || n < decimal_threshold) {
+		write_decimal_basecase(a, n, out, width);
+		return;
+	}
+
+	const LimbSpan& power = powers[k - 1];
+	if (n < power.size) {
+		write_decimal(a, n, powers, k - 1, out + width / 2, scratch, num_threads);
+		return;
+	}
+
+	std::uint32_t* high = scratch;
+	std::size_t high_size = n - power.size + 1;
+	divmod_n(high, a, a, n, power.data, power.size, high + high_size);
+
+	if (num_threads > 1 && 32 * n >= parallel_cutoff_bits) {
+		unsigned int sub_threads = (num_threads + 1) / 2;
+		std::thread worker(write_decimal_on_thread, high, high_size, powers, k - 1,
+			out, sub_threads);
+		write_decimal(a, power.size, powers, k - 1, out + width / 2, high + high_size,
+			num_threads - sub_threads);
+		worker.join();
+	}
+	else {
+		write_decimal(high, high_size, powers, k - 1, out, high + high_size, 1);
+		write_decimal(a, power.size, powers, k - 1, out + width / 2, high + high_size, 1);
+	}
+}
+
+// Return the number of significant bits in a.
+static unsigned int bit_length(const std::uint32_t* a, std::size_t n) {
+	if (n == 0) {
+		return 0;
+	}
+
+	unsigned int num_bits = 32 * (n - 1);
+	for (std::uint32_t top = a[n - 1]; top != 0; top >>= 1) {
+		++num_bits;
+	}
+
+	return num_bits;
+}
+
+static unsigned int bit_length(const Limbs& a) {
+	return bit_length(a.data(), a.size());
+}
+
+// Return the decimal representation of a (without leading zeros).
+static std::string to_decimal(Limbs a) {
+	if (a.empty()) {
+		return "0";
+	}
+
+	// Square 10^9 until the square of the last power would exceed a; a then
+	// has at most 9 * 2^k digits. Bit lengths decide this without computing
+	// that square (the largest, and never used as a divisor): a power p of b
+	// bits has p^2 >= 2^(2b - 2), so a < p^2 once a has at most 2b - 2 bits.
+	// The powers are taken from the scratch stack one after another, and all
+	// of them are given back when powers_frame goes out of scope.
+	ScratchFrame powers_frame(1);
+	powers_frame.data()[0] = decimal_base;
+
+	LimbSpan powers[max_decimal_powers];
+	powers[0].data = powers_frame.data();
+	powers[0].size = 1;
+
+	std::size_t k = 1;
+	unsigned int num_bits = bit_length(a);
+	while (2 * bit_length(powers[k - 1].data, powers[k - 1].size) - 2 < num_bits) {
+		const LimbSpan& last = powers[k - 1];
+		std::uint32_t* square = scratch_stack.take(2 * last.size);
+		mul_n(square, last.data, last.size, last.data, last.size);
+
+		powers[k].data = square;
+		powers[k].size = trimmed_length(square, 2 * last.size);
+		++k;
+	}
+
+	std::string str(decimal_base_digits << k, '0');
+
+	unsigned int num_threads = 1;
+	if (32 * a.size() >= parallel_cutoff_bits) {
+		num_threads = available_threads();
+	}
+
+	ScratchFrame frame(decimal_scratch(powers, k, a.size()));
+	write_decimal(a.data(), a.size(), powers, k, &str[0], frame.data(), num_threads);
+
+	return str.substr(str.find_first_not_of('0'));
+}
+
+// Return bit i of a (false past the most significant bit).
+static bool test_bit(const Limbs& a, unsigned int i) {
+	return (i / 32 < a.size()) && ((a[i / 32] >> (i % 32)) & 1);
+}
+
+static Limbs from_uint64(std::uint64_t val) {
+	Limbs a;
+	a.push_back(std::uint32_t(val));
+	a.push_back(std::uint32_t(val >> 32));
+	trim(a);
+	return a;
+}
+
+// Return the low 64 bits of a[0, n).
+static std::uint64_t to_uint64(const std::uint32_t* a, std::size_t n) {
+	std::uint64_t val = 0;
+	for (std::size_t i = std::min<std::size_t>(n, 2); i-- > 0; ) {
+		val = (val << 32) | a[i];
+	}
+	return val;
+}
+
+static std::uint64_t to_uint64(const Limbs& a) {
+	return to_uint64(a.data(), a.size());
+}
+
+// Store x * w in r[0, rn), where x has fewer than rn limbs.
+static void mul_word(std::uint32_t* r, std::size_t rn, const std::uint32_t* x,
+	std::size_t xn, std::uint32_t w) {
+
+	std::fill(r + xn, r + rn, 0);
+	if (xn != 0) {
+		r[xn] = kernels()->mul_1(r, x, xn, w);
+	}
+}
+
+// Compute p * x + q * y into r[0, rn) for coefficients of opposite signs (one
+// may be 0), i.e. the difference of two products, where |p|, |q| < 2^32 and
+// x and y have fewer than rn limbs. The difference must be non-negative.
+// w[0, rn) is scratch.
+// @return the length of the result
+static std::size_t lin_comb(std::uint32_t* r, std::size_t rn, std::int64_t p,
+	const std::uint32_t* x, std::size_t xn, std::int64_t q, const std::uint32_t* y,
+	std::size_t yn, std::uint32_t* w) {
+
+	// Arrange the sum as p * x - (-q) * y with p >= 0 and q <= 0.
+	if (p < 0 || q > 0) {
+		std::swap(p, q);
+		std::swap(x, y);
+		std::swap(xn, yn);
+	}
+
+	mul_word(r, rn, x, xn, std::uint32_t(p));
+	mul_word(w, rn, y, yn, std::uint32_t(-q));
+	sub_from(r, rn, w, yn + 1);
+
+	return trimmed_length(r, rn);
+}
+
+// Replace x[0, xn) by x - y modulo m[0, mn), where x and y are reduced
+// modulo m and x can hold mn + 1 limbs.
+// @return the length of the result
+static std::size_t sub_mod_in_place(std::uint32_t* x, std::size_t xn, const std::uint32_t* y,
+	std::size_t yn, const std::uint32_t* m, std::size_t mn) {
+
+	std::fill(x + xn, x + mn + 1, 0);
+	if (compare_n(x, xn, y, yn) < 0) {
+		add_into(x, mn + 1, m, mn);
+	}
+	sub_from(x, mn + 1, y, yn);
+
+	return trimmed_length(x, mn + 1);
+}
+
+// Compute p * x + q * y modulo m[0, mn) into r, for coefficients as in
+// lin_comb and x and y reduced modulo m. r and w must hold mn + 1 limbs.
+// @return the length of the result
+static std::size_t lin_comb_mod(std::uint32_t* r, std::int64_t p, const std::uint32_t* x,
+	std::size_t xn, std::int64_t q, const std::uint32_t* y, std::size_t yn,
+	const std::uint32_t* m, std::size_t mn, std::uint32_t* w) {
+
+	if (p < 0 || q > 0) {
+		std::swap(p, q);
+		std::swap(x, y);
+		std::swap(xn, yn);
+	}
+
+	mul_word(r, mn + 1, x, xn, std::uint32_t(p));
+	mul_word(w, mn + 1, y, yn, std::uint32_t(-q));
+	std::size_t rn = mod_in_place(r, mn + 1, m, mn);
+	std::size_t wn = mod_in_place(w, mn + 1, m, mn);
+
+	return sub_mod_in_place(r, rn, w, wn, m, mn);
+}
+
+// Return the 32 bits of a[0, n) from bit shift upwards, where
+// a < 2^(shift + 32).
+static std::uint32_t leading_word(const std::uint32_t* a, std::size_t n, unsigned int shift) {
+	std::size_t i = shift / 32;
+	std::uint64_t t = (i < n) ? a[i] : 0;
+	if (i + 1 < n) {
+		t |= std::uint64_t(a[i + 1]) << 32;
+	}
+	return std::uint32_t(t >> (shift % 32));
+}
+
+// The binary GCD algorithm on machine words: strip common factors of 2, then
+// repeatedly subtract the smaller odd value from the larger.
+static std::uint64_t binary_gcd(std::uint64_t a, std::uint64_t b) {
+	if (a == 0) return b;
+	if (b == 0) return a;
+
+	int shift = __builtin_ctzll(a | b);
+	a >>= __builtin_ctzll(a);
+
+	while (b != 0) {
+		b >>= __builtin_ctzll(b);
+		if (a > b) {
+			std::uint64_t t = a;
+			a = b;
+			b = t;
+		}
+		b -= a;
+	}
+
+	return a << shift;
+}
+
+// Compute gcd(a, b) with Lehmer's algorithm. Rather than dividing the full
+// values at every step, Lehmer's algorithm runs Euclid's algorithm on their
+// leading 32 bits, collecting the steps in a 2x2 matrix of single-word
+// cofactors, and only then applies the matrix to the full values. This
+// replaces up to ~16 long divisions with four multiplications by one word.
+//
+// If coefficient is not null, the cofactors s0 and s1 are updated alongside
+// the remainders r0 and r1 modulo m. Starting from s0 = 1, s1 = 0 (with
+// a < m = b) they track the coefficient x of a Bezout identity
+// a * x + b * y = gcd, and x mod m is stored in coefficient.
+//
+// The remainders, the cofactors and the next values of each live in one
+// frame on the scratch stack, and every step writes into the spare buffers
+// and swaps them in, so only the gcd and the coefficient are allocated.
+// @return the gcd
+static Limbs lehmer_gcd(const Limbs& a, const Limbs& b, const Limbs& m, Limbs* coefficient) {
+	std::size_t n = std::max(a.size(), b.size()) + 1;
+	std::size_t mn = m.size();
+	std::size_t sn = (coefficient != nullptr) ? mn + 1 : 0;
+
+	// r0, r1 and their next values, then the same for s0 and s1, and a
+	// product buffer for each.
+	ScratchFrame frame(5 * n + 5 * sn);
+	std::uint32_t* r0 = frame.data();
+	std::uint32_t* r1 = r0 + n;
+	std::uint32_t* next_r0 = r1 + n;
+	std::uint32_t* next_r1 = next_r0 + n;
+	std::uint32_t* r_work = next_r1 + n;
+	std::uint32_t* s0 = r_work + n;
+	std::uint32_t* s1 = s0 + sn;
+	std::uint32_t* next_s0 = s1 + sn;
+	std::uint32_t* next_s1 = next_s0 + sn;
+	std::uint32_t* s_work = next_s1 + sn;
+
+	std::size_t r0n = a.size();
+	std::size_t r1n = b.size();
+	std::size_t s0n = 0;
+	std::size_t s1n = 0;
+	std::copy(a.begin(), a.end(), r0);
+	std::copy(b.begin(), b.end(), r1);
+	if (coefficient != nullptr) {
+		s0[0] = 1;
+		s0n = 1;
+	}
+
+	if (compare_n(r0, r0n, r1, r1n) < 0) {
+		std::swap(r0, r1);
+		std::swap(r0n, r1n);
+		std::swap(s0, s1);
+		std::swap(s0n, s1n);
+	}
+
+	while (r1n != 0) {
+
+		// Once both values fit in a word, finish with the binary algorithm.
+		if (coefficient == nullptr && r0n <= 2) {
+			return from_uint64(binary_gcd(to_uint64(r0, r0n), to_uint64(r1, r1n)));
+		}
+
+		std::int64_t A = 1, B = 0, C = 0, D = 1;
+
+		unsigned int num_bits = bit_length(r0, r0n);
+		if (num_bits > 64) {
+
+			// The leading 32 bits of r0, and the bits of r1 in the same places
+			std::int64_t x = leading_word(r0, r0n, num_bits - 32);
+			std::int64_t y = leading_word(r1, r1n, num_bits - 32);
+
+			// Run Euclid on (x, y) for as long as the quotients of the
+			// approximations (x + A) / (y + C) and (x + B) / (y + D) agree,
+			// which guarantees they are also the quotients of the full values.
+			while (y + C != 0 && y + D != 0) {
+				std::int64_t q1 = (x + A) / (y + C);
+				std::int64_t q2 = (x + B) / (y + D);
+				if (q1 != q2) {
+					break;
+				}
+
+				std::int64_t t = A - q1 * C;
+				A = C;
+				C = t;
+				t = B - q1 * D;
+				B = D;
+				D = t;
+				t = x - q1 * y;
+				x = y;
+				y = t;
+			}
+		}
+
+		if (B == 0) {
+
+			// No progress on the leading bits (or the values are small), so take
+			// a single step of Euclid's algorithm with a full division. The
+			// quotient goes to next_r0 and the remainder replaces r0.
+			std::size_t qn = r0n - r1n + 1;
+			divmod_in_place(next_r0, r0, r0n, r1, r1n);
+			r0n = trimmed_length(r0, r1n);
+			qn = trimmed_length(next_r0, qn);
+
+			// s0 - q * s1 (mod m)
+			if (coefficient != nullptr && qn != 0 && s1n != 0) {
+				ScratchFrame product(qn + s1n);
+				mul_n(product.data(), next_r0, qn, s1, s1n);
+				std::size_t pn = mod_in_place(product.data(), qn + s1n, m.data(), mn);
+				s0n = sub_mod_in_place(s0, s0n, product.data(), pn, m.data(), mn);
+			}
+
+			std::swap(r0, r1);
+			std::swap(r0n, r1n);
+			std::swap(s0, s1);
+			std::swap(s0n, s1n);
+		}
+		else {
+			std::size_t next_r0n = lin_comb(next_r0, n, A, r0, r0n, B, r1, r1n, r_work);
+			r1n = lin_comb(next_r1, n, C, r0, r0n, D, r1, r1n, r_work);
+			r0n = next_r0n;
+			std::swap(r0, next_r0);
+			std::swap(r1, next_r1);
+
+			if (coefficient != nullptr) {
+				std::size_t next_s0n = lin_comb_mod(next_s0, A, s0, s0n, B, s1, s1n,
+					m.data(), mn, s_work);
+				s1n = lin_comb_mod(next_s1, C, s0, s0n, D, s1, s1n, m.data(), mn, s_work);
+				s0n = next_s0n;
+				std::swap(s0, next_s0);
+				std::swap(s1, next_s1);
+			}
+		}
+	}
+
+	if (coefficient != nullptr) {
+		coefficient->assign(s0, s0 + s0n);
+	}
+
+	return Limbs(r0, r0 + r0n);
+}
+
+static Limbs gcd(const Limbs& a, const Limbs& b) {
+	return lehmer_gcd(a, b, Limbs(), nullptr);
+}
+
+// Compute the inverse of a modulo m.
+// @return false (leaving inv untouched) if gcd(a, m) != 1
+static bool invert(const Limbs& a, const Limbs& m, Limbs& inv) {
+	Limbs s0;
+	Limbs g = lehmer_gcd(mod(a, m), m, m, &s0);
+
+	if (!(g.size() == 1 && g[0] == 1)) {
+		return false;
+	}
+
+	inv = mod(s0, m);
+	return true;
+}
+
+// Precomputed values for Montgomery multiplication modulo an odd m. With
+// R = 2^(32 * m.size()), a value x is kept in "Montgomery form" x * R mod m,
+// and the product of two such values can be reduced with multiplications and
+// shifts only (no division).
+struct Montgomery {
+	Limbs m;
+	std::uint32_t m_inv; // -m^(-1) mod 2^32
+	Limbs r2;            // R^2 mod m
+	Limbs one;           // R mod m, i.e. 1 in Montgomery form
+};
+
+static Montgomery make_montgomery(const Limbs& m) {
+	Montgomery ctx;
+	ctx.m = m;
+
+	// Newton's iteration doubles the number of correct low bits of the
+	// inverse each step; 5 steps take 1 correct bit (m is odd) past 32.
+	std::uint32_t inv = 1;
+	for (int i = 0; i < 5; ++i) {
+		inv *= 2 - m[0] * inv;
+	}
+	ctx.m_inv = -inv;
+
+	Limbs one(1, 1);
+	ctx.one = mod(shift_left(one, 32 * m.size()), m);
+	ctx.r2 = mod(shift_left(one, 64 * m.size()), m);
+
+	return ctx;
+}
+
+// Montgomery product a * b * R^(-1) mod m for a, b < m, computed with the
+// SOS (separated operand scanning) method: first the full product t = a * b,
+// then n reduction steps, each adding the multiple u * m which clears the
+// lowest remaining limb of t. Both halves are multiply-accumulate loops, so
+// they run on the active kernel set. m_inv is -m^(-1) mod 2^32.
+static Limbs mont_mul(const Limbs& a, const Limbs& b, const Limbs& m,
+	std::uint32_t m_inv) {
+
+	std::size_t n = m.size();
+	Limbs t = mul(a, b);
+	t.resize(2 * n + 1, 0);
+
+	for (std::size_t i = 0; i < n; ++i) {
+		std::uint32_t u = t[i] * m_inv;
+		std::uint32_t carry = kernels()->addmul_1(&t[i], m.data(), n, u);
+
+		// Ripple the carry into the upper half of t.
+		for (std::size_t j = i + n; carry != 0; ++j) {
+			t[j] += carry;
+			carry = (t[j] < carry) ? 1 : 0;
+		}
+	}
+
+	// The low n limbs are now 0; what remains is t / R < 2m.
+	t.erase(t.begin(), t.begin() + n);
+	trim(t);
+
+	if (compare(t, m) >= 0) {
+		t = sub(t, m);
+	}
+
+	return t;
+}
+
+static Limbs mont_mul(const Limbs& a, const Limbs& b, const Montgomery& ctx) {
+	return mont_mul(a, b, ctx.m, ctx.m_inv);
+}
+
+static Limbs to_montgomery(const Limbs& a, const Montgomery& ctx) {
+	return mont_mul(a, ctx.r2, ctx);
+}
+
+static Limbs from_montgomery(const Limbs& a, const Montgomery& ctx) {
+	return mont_mul(a, Limbs(1, 1), ctx);
+}
+
+// Choose the width of the sliding window used for an exponent with num_bits
+// bits. Wider windows need a larger table of precomputed odd powers but fewer
+// multiplications.
+static int window_size(int num_bits) {
+	if (num_bits > 671) return 6;
+	if (num_bits > 239) return 5;
+	if (num_bits > 79) return 4;
+	if (num_bits > 23) return 3;
+	return 2;
+}
+
+// Left-to-right sliding window exponentiation. mul_mod is a function object
+// which multiplies two reduced values; base must already be reduced and one
+// must be the representation of 1.
+template <typename MulMod>
+static Limbs window_pow(const Limbs& base, const Limbs& exp, const Limbs& one,
+	MulMod mul_mod) {
+
+	int top = bit_length(exp) - 1;
+	int k = window_size(top + 1);
+
+	// table[i] stores base^(2i + 1)
+	std::vector<Limbs> table(1 << (k - 1));
+	table[0] = base;
+	Limbs base_sqr = mul_mod(base, base);
+	for (std::size_t i = 1; i < table.size(); ++i) {
+		table[i] = mul_mod(table[i - 1], base_sqr);
+	}
+
+	Limbs result = one;
+	bool started = false; // avoid squaring the initial 1
+
+	int i = top;
+	while (i >= 0) {
+		if (!test_bit(exp, i)) {
+			if (started) {
+				result = mul_mod(result, result);
+			}
+			--i;
+			continue;
+		}
+
+		// Find the longest window exp[i..j] of at most k bits ending in a 1.
+		int j = (i - k + 1 > 0) ? i - k + 1 : 0;
+		while (!test_bit(exp, j)) {
+			++j;
+		}
+
+		unsigned int window = 0;
+		for (int l = i; l >= j; --l) {
+			window = 2 * window + (test_bit(exp, l) ? 1 : 0);
+			if (started) {
+				result = mul_mod(result, result);
+			}
+		}
+
+		if (started) {
+			result = mul_mod(result, table[window / 2]);
+		}
+		else {
+			result = table[window / 2];
+			started = true;
+		}
+
+		i = j - 1;
+	}
+
+	return result;
+}
+
+// Compute base^exp mod m for a non-zero m and base < m.
+static Limbs powmod(const Limbs& b, const Limbs& e, const Limbs& m) {
+
+	// Everything is 0 modulo 1
+	if (m.size() == 1 && m[0] == 1) {
+		return Limbs();
+	}
+
+	if (e.empty()) {
+		return Limbs(1, 1);
+	}
+
+	if (m[0] & 1) {
+
+		// Odd modulus: work in Montgomery form so that every step of the
+		// exponentiation avoids division.
+		Montgomery ctx = make_montgomery(m);
+		Limbs result = window_pow(to_montgomery(b, ctx), e, ctx.one,
+			[&ctx](const Limbs& x, const Limbs& y) { return mont_mul(x, y, ctx); });
+
+		return from_montgomery(result, ctx);
+	}
+
+	// Even modulus: Montgomery reduction needs m to be odd, so fall back on
+	// multiplying and reducing with long division.
+	return window_pow(b, e, Limbs(1, 1),
+		[&m](const Limbs& x, const Limbs& y) { return ::mod(mul(x, y), m); });
+}
+
+Integer powmod(const Integer& base, const Integer& exp, const Integer& mod) {
+
+	// Check for modulus by 0!
+	if (mod.is_zero()) {
+		std::cout << "Modulus by 0 error!" << std::endl;
+		return Integer(0);
+	}
+
+	Limbs m = to_limbs(mod);
+	return from_limbs(powmod(::mod(to_limbs(base), m), to_limbs(exp), m));
+}
+
+// Barrett reduction of x modulo m, where mu = floor(2^(64k) / m) and k is the
+// number of limbs of m. The quotient estimate q3 below is never too large and
+// is at most 2 too small, so at most two corrections are needed.
+static Limbs barrett_reduce(const Limbs& x, const Limbs& m, const Limbs& mu) {
+	std::size_t k = m.size();
+
+	// The estimate only holds for x < 2^(64k); fall back on long division.
+	if (x.size() > 2 * k) {
+		return mod(x, m);
+	}
+
+	if (compare(x, m) < 0) {
+		return x;
+	}
+
+	Limbs q = shift_right(mul(shift_right(x, 32 * (k - 1)), mu), 32 * (k + 1));
+	Limbs r = sub(x, mul(q, m));
+
+	while (compare(r, m) >= 0) {
+		r = sub(r, m);
+	}
+
+	return r;
+}
+
+ModContext::ModContext(const Integer& modulus)
+	: modulus_(modulus), montgomery_(false), m_inv_(0) {
+
+	// Check for modulus by 0!
+	if (modulus.is_zero()) {
+		std::cout << "Modulus by 0 error!" << std::endl;
+		return;
+	}
+
+	m_ = to_limbs(modulus);
+
+	Limbs one(1, 1);
+	Limbs remainder;
+	divmod(shift_left(one, 64 * m_.size()), m_, mu_, remainder);
+
+	// Odd moduli additionally get the values needed for Montgomery form, which
+	// ModInteger uses to multiply without any reduction by division.
+	montgomery_ = (m_[0] & 1);
+	if (montgomery_) {
+		Montgomery mont = make_montgomery(m_);
+		m_inv_ = mont.m_inv;
+		r2_ = mont.r2;
+	}
+}
+
+Integer ModContext::reduce(const Integer& val) const {
+
+	// Reducing by 0 leaves val unchanged, just like operator%=
+	if (m_.empty()) {
+		return val;
+	}
+
+	return from_limbs(barrett_reduce(to_limbs(val), m_, mu_));
+}
+
+Integer ModContext::mul(const Integer& lhs, const Integer& rhs) const {
+
+	if (m_.empty()) {
+		return lhs * rhs;
+	}
+
+	return from_limbs(barrett_reduce(::mul(to_limbs(lhs), to_limbs(rhs)), m_, mu_));
+}
+
+ModInteger::ModInteger(const ModContext& ctx) : ctx_(&ctx) {
+}
+
+ModInteger::ModInteger(const Integer& val, const ModContext& ctx) : ctx_(&ctx) {
+	if (ctx.m_.empty()) {
+		val_ = to_limbs(val);
+		return;
+	}
+
+	val_ = barrett_reduce(to_limbs(val), ctx.m_, ctx.mu_);
+
+	// Move to Montgomery form: val * R mod m
+	if (ctx.montgomery_) {
+		val_ = mont_mul(val_, ctx.r2_, ctx.m_, ctx.m_inv_);
+	}
+}
+
+Integer ModInteger::value() const {
+	if (ctx_->montgomery_) {
+		return from_limbs(mont_mul(val_, Limbs(1, 1), ctx_->m_, ctx_->m_inv_));
+	}
+
+	return from_limbs(val_);
+}
+
+ModInteger& ModInteger::operator+=(const ModInteger& rhs) {
+	val_ = add(val_, rhs.val_);
+
+	if (!ctx_->m_.empty() && compare(val_, ctx_->m_) >= 0) {
+		val_ = sub(val_, ctx_->m_);
+	}
+
+	return *this;
+}
+
+ModInteger& ModInteger::operator-=(const ModInteger& rhs) {
+	if (compare(val_, rhs.val_) >= 0) {
+		val_ = sub(val_, rhs.val_);
+	}
+	else if (ctx_->m_.empty()) {
+		// Without a modulus, behave like Integer::operator-=
+		val_ = sub(rhs.val_, val_);
+	}
+	else {
+		// Wrap around: val - rhs + m
+		val_ = sub(add(val_, ctx_->m_), rhs.val_);
+	}
+
+	return *this;
+}
+
+ModInteger& ModInteger::operator*=(const ModInteger& rhs) {
+	const ModContext& ctx = *ctx_;
+
+	if (ctx.montgomery_) {
+		// (aR)(bR)R^(-1) = (ab)R, so the product stays in Montgomery form
+		val_ = mont_mul(val_, rhs.val_, ctx.m_, ctx.m_inv_);
+	}
+	else if (ctx.m_.empty()) {
+		val_ = mul(val_, rhs.val_);
+	}
+	else {
+		val_ = barrett_reduce(mul(val_, rhs.val_), ctx.m_, ctx.mu_);
+	}
+
+	return *this;
+}
+
+ModInteger ModInteger::inverse() const {
+	ModInteger inv(*ctx_);
+
+	Limbs plain = to_limbs(value());
+	Limbs plain_inv;
+
+	if (ctx_->m_.empty() || !invert(plain, ctx_->m_, plain_inv)) {
+		std::cout << "No modular inverse error!" << std::endl;
+		return inv;
+	}
+
+	inv.val_ = plain_inv;
+	if (ctx_->montgomery_) {
+		inv.val_ = mont_mul(plain_inv, ctx_->r2_, ctx_->m_, ctx_->m_inv_);
+	}
+
+	return inv;
+}
+
+ModInteger operator+(ModInteger lhs, const ModInteger& rhs) {
+	lhs += rhs;
+	return lhs;
+}
+
+ModInteger operator-(ModInteger lhs, const ModInteger& rhs) {
+	lhs -= rhs;
+	return lhs;
+}
+
+ModInteger operator*(ModInteger lhs, const ModInteger& rhs) {
+	lhs *= rhs;
+	return lhs;
+}
+
+bool operator==(const ModInteger& lhs, const ModInteger& rhs) {
+	// Both values are in the same (reduced) form, so compare them directly.
+	return compare(lhs.val_, rhs.val_) == 0;
+}
+
+Integer gcd(const Integer& a, const Integer& b) {
+	return from_limbs(gcd(to_limbs(a), to_limbs(b)));
+}
+
+Integer lcm(const Integer& a, const Integer& b) {
+	if (a.is_zero() || b.is_zero()) {
+		return Integer(0);
+	}
+
+	// Divide before multiplying to keep the intermediate value small.
+	Limbs a_limbs = to_limbs(a);
+	Limbs b_limbs = to_limbs(b);
+	Limbs q, r;
+	divmod(a_limbs, gcd(a_limbs, b_limbs), q, r);
+
+	return from_limbs(mul(q, b_limbs));
+}
+
+Integer ext_gcd(const Integer& a, const Integer& b, SignedInteger& x,
+	SignedInteger& y) {
+
+	Limbs a_limbs = to_limbs(a);
+	Limbs b_limbs = to_limbs(b);
+
+	// gcd(a, 0) = a = a * 1 + 0 * 0
+	if (b_limbs.empty()) {
+		x = SignedInteger(1);
+		y = SignedInteger(0);
+		return a;
+	}
+
+	// Track the coefficient of a modulo b. Any x can be shifted by multiples of
+	// b / g, so reduce it to the smallest one, 0 <= x < b / g. Then y follows
+	// from the exact division y = (g - a * x) / b.
+	Limbs s0;
+	Limbs g = lehmer_gcd(mod(a_limbs, b_limbs), b_limbs, b_limbs, &s0);
+
+	Limbs b_over_g, r;
+	divmod(b_limbs, g, b_over_g, r);
+	Limbs x_limbs = mod(s0, b_over_g);
+
+	Integer x_mag = from_limbs(x_limbs);
+	x = SignedInteger(x_mag);
+
+	Limbs ax = mul(a_limbs, x_limbs);
+	if (compare(ax, g) < 0) {
+
+		// Only possible if x = 0, in which case g = b and y = 1.
+		y = SignedInteger(1);
+	}
+	else {
+		Limbs q;
+		divmod(sub(ax, g), b_limbs, q, r);
+
+		Integer y_mag = from_limbs(q);
+		y = SignedInteger(y_mag);
+		if (!y.is_zero()) {
+			y.negate();
+		}
+	}
+
+	return from_limbs(g);
+}
+
+SignedInteger ext_gcd(const SignedInteger& a, const SignedInteger& b,
+	SignedInteger& x, SignedInteger& y) {
+
+	// Work with |a| and |b|, then move the signs onto the coefficients:
+	// |a| x + |b| y = g  means  a (sign(a) x) + b (sign(b) y) = g.
+	Integer g = ext_gcd(a.magnitude(), b.magnitude(), x, y);
+
+	if (a.is_negative() && !x.is_zero()) {
+		x.negate();
+	}
+
+	if (b.is_negative() && !y.is_zero()) {
+		y.negate();
+	}
+
+	return SignedInteger(g);
+}
+
+Integer mod_inverse(const Integer& a, const Integer& m) {
+	Limbs inv;
+
+	// Check for modulus by 0!
+	if (m.is_zero()) {
+		std::cout << "Modulus by 0 error!" << std::endl;
+		return Integer(0);
+	}
+
+	if (!invert(to_limbs(a), to_limbs(m), inv)) {
+		std::cout << "No modular inverse error!" << std::endl;
+		return Integer(0);
+	}
+
+	return from_limbs(inv);
+}
+
+Integer mod_inverse(const SignedInteger& a, const Integer& m) {
+	Integer inv = mod_inverse(a.magnitude(), m);
+
+	// The inverse of -a is -(a^(-1)), i.e. m - a^(-1)
+	if (a.is_negative() && !inv.is_zero()) {
+		inv = m - inv;
+	}
+
+	return inv;
+}
+
+// Compute a^k by repeated squaring.
+static Limbs power(const Limbs& a, unsigned int k) {
+	Limbs result(1, 1);
+	Limbs square = a;
+
+	while (k != 0) {
+		if (k & 1) {
+			result = mul(result, square);
+		}
+		k >>= 1;
+		if (k != 0) {
+			square = mul(square, square);
+		}
+	}
+
+	return result;
+}
+
+// Compute a[0, an)^e for e >= 1 and a non-zero by repeated squaring, with
+// the buffers r, s and t in turn holding the result, the current square and
+// each new product; each must hold as many limbs as a^e plus two.
+// @return whichever of the buffers holds the result (its length goes to rn)
+static std::uint32_t* power_n(const std::uint32_t* a, std::size_t an, unsigned int e,
+	std::uint32_t* r, std::uint32_t* s, std::uint32_t* t, std::size_t& rn) {
+
+	std::copy(a, a + an, s);
+	std::size_t sn = an;
+	rn = 0;
+
+	while (true) {
+		if (e & 1) {
+			if (rn == 0) {
+				std::copy(s, s + sn, r);
+				rn = sn;
+			}
+			else {
+				mul_n(t, r, rn, s, sn);
+				rn = trimmed_length(t, rn + sn);
+				std::swap(r, t);
+			}
+		}
+
+		e >>= 1;
+		if (e == 0) {
+			return r;
+		}
+
+		mul_n(t, s, sn, s, sn);
+		sn = trimmed_length(t, 2 * sn);
+		std::swap(s, t);
+	}
+}
+
+// Compute floor(n^(1/k)) for k >= 2 with Newton's iteration
+//   x <- ((k - 1) x + n / x^(k-1)) / k.
+// Starting from any x >= the root, the iterates decrease monotonically until
+// they reach the root, so we stop as soon as they stop decreasing. The
+// iterates, x^(k-1), the quotient and the copy of n it is divided in place
+// all live in one frame on the scratch stack.
+static Limbs root(const Limbs& n, unsigned int k) {
+	if (n.empty()) {
+		return n;
+	}
+
+	// n < 2^k, so the root is 1.
+	unsigned int num_bits = bit_length(n);
+	if (k >= num_bits) {
+		return Limbs(1, 1);
+	}
+
+	// 2^ceil(bits / k) is at least the root, and x^(k-1) has at most
+	// (k - 1) ceil(bits / k) < bits + k bits.
+	unsigned int x_bits = (num_bits + k - 1) / k;
+	std::size_t nn = n.size();
+	std::size_t yn_max = std::max<std::size_t>(nn, x_bits / 32 + 1) + 2;
+	std::size_t pn_max = (k > 2) ? (num_bits + k) / 32 + 3 : 0;
+
+	ScratchFrame frame(2 * yn_max + 2 * nn + 1 + 3 * pn_max);
+	std::uint32_t* x = frame.data();
+	std::uint32_t* y = x + yn_max;
+	std::uint32_t* u = y + yn_max;
+	std::uint32_t* q = u + nn;
+	std::uint32_t* powers = q + nn + 1;
+
+	std::size_t xn = x_bits / 32 + 1;
+	std::fill(x, x + xn, 0);
+	x[xn - 1] = std::uint32_t(1) << (x_bits % 32);
+
+	while (true) {
+		const std::uint32_t* d = x;
+		std::size_t dn = xn;
+		if (k > 2) {
+			d = power_n(x, xn, k - 1, powers, powers + pn_max, powers + 2 * pn_max, dn);
+		}
+
+		std::copy(n.begin(), n.end(), u);
+		std::size_t qn = 0;
+		if (compare_n(u, nn, d, dn) >= 0) {
+			qn = nn - dn + 1;
+			divmod_in_place(q, u, nn, d, dn);
+			qn = trimmed_length(q, qn);
+		}
+
+		mul_word(y, yn_max, x, xn, k - 1);
+		add_into(y, yn_max, q, qn);
+		divmod_1(y, yn_max, k);
+		std::size_t yn = trimmed_length(y, yn_max);
+
+		if (compare_n(y, yn, x, xn) >= 0) {
+			return Limbs(x, x + xn);
+		}
+
+		std::swap(x, y);
+		xn = yn;
+	}
+}
+
+// A cheap test which rules out most non-squares without taking a root: a
+// square must be a quadratic residue modulo 64, 63, 65 and 11. Only about 1 in
+// 170 non-squares passes all four checks.
+static bool may_be_square(const Limbs& n) {
+	if (n.empty()) {
+		return true;
+	}
+
+	// Tables of quadratic residues, built once.
+	static const std::vector<bool> res64 = [] {
+		std::vector<bool> t(64, false);
+		for (unsigned int i = 0; i < 64; ++i) t[(i * i) % 64] = true;
+		return t;
+	}();
+	static const std::vector<bool> res63 = [] {
+		std::vector<bool> t(63, false);
+		for (unsigned int i = 0; i < 63; ++i) t[(i * i) % 63] = true;
+		return t;
+	}();
+	static const std::vector<bool> res65 = [] {
+		std::vector<bool> t(65, false);
+		for (unsigned int i = 0; i < 65; ++i) t[(i * i) % 65] = true;
+		return t;
+	}();
+	static const std::vector<bool> res11 = [] {
+		std::vector<bool> t(11, false);
+		for (unsigned int i = 0; i < 11; ++i) t[(i * i) % 11] = true;
+		return t;
+	}();
+
+	if (!res64[n[0] % 64]) {
+		return false;
+	}
+
+	// A single pass computes n mod 63 * 65 * 11
+	Limbs q, r;
+	divmod(n, Limbs(1, 63 * 65 * 11), q, r);
+	std::uint32_t residue = r.empty() ? 0 : r[0];
+
+	return res63[residue % 63] && res65[residue % 65] && res11[residue % 11];
+}
+
+// Return the number of times 2 divides a non-zero n.
+static unsigned int trailing_zeros(const Limbs& n) {
+	unsigned int i = 0;
+	while (n[i] == 0) {
+		++i;
+	}
+	return 32 * i + __builtin_ctz(n[i]);
+}
+
+Integer isqrt(const Integer& val) {
+	return from_limbs(root(to_limbs(val), 2));
+}
+
+Integer iroot(const Integer& val, unsigned int n) {
+	if (n == 0) {
+		std::cout << "Zeroth root error!" << std::endl;
+		return val;
+	}
+
+	if (n == 1) {
+		return val;
+	}
+
+	return from_limbs(root(to_limbs(val), n));
+}
+
+bool is_perfect_square(const Integer& val) {
+	Limbs n = to_limbs(val);
+
+	if (!may_be_square(n)) {
+		return false;
+	}
+
+	Limbs r = root(n, 2);
+	return compare(mul(r, r), n) == 0;
+}
+
+bool is_perfect_power(const Integer& val) {
+	Limbs n = to_limbs(val);
+
+	// 0 = 0^2 and 1 = 1^2
+	if (n.empty() || (n.size() == 1 && n[0] == 1)) {
+		return true;
+	}
+
+	if (may_be_square(n) && compare(power(root(n, 2), 2), n) == 0) {
+		return true;
+	}
+
+	// If n = a^k, then n is also a p-th power for every prime p dividing k, so
+	// only prime exponents need checking. Since 2^k <= n, k < bit_length(n).
+	// Also, the number of factors of 2 in a^p is a multiple of p.
+	unsigned int num_bits = bit_length(n);
+	unsigned int twos = trailing_zeros(n);
+
+	for (unsigned int p = 3; p < num_bits; p += 2) {
+		bool prime = true;
+		for (unsigned int d = 3; d * d <= p; d += 2) {
+			if (p % d == 0) {
+				prime = false;
+				break;
+			}
+		}
+
+		if (!prime || twos % p != 0) {
+			continue;
+		}
+
+		if (compare(power(root(n, p), p), n) == 0) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// The odd primes below 4096, computed once with the sieve of Eratosthenes.
+static const std::vector<std::uint32_t>& small_primes() {
+	static const std::vector<std::uint32_t> primes = [] {
+		const std::uint32_t limit = 4096;
+		std::vector<bool> composite(limit, false);
+		std::vector<std::uint32_t> table;
+
+		for (std::uint32_t i = 3; i < limit; i += 2) {
+			if (!composite[i]) {
+				table.push_back(i);
+				for (std::uint32_t j = i * i; j < limit; j += 2 * i) {
+					composite[j] = true;
+				}
+			}
+		}
+
+		return table;
+	}();
+
+	return primes;
+}
+
+// Compute n mod p for every p in small_primes(). Primes are grouped so that
+// the product of each group fits in one limb; n is then divided once per group
+// (a single pass over its limbs) and the residues are read off that remainder.
+static std::vector<std::uint32_t> small_prime_residues(const Limbs& n) {
+	const std::vector<std::uint32_t>& primes = small_primes();
+	std::vector<std::uint32_t> residues(primes.size(), 0);
+
+	std::size_t i = 0;
+	while (i < primes.size()) {
+		std::uint64_t product = primes[i];
+		std::size_t end = i + 1;
+		while (end < primes.size() && product * primes[end] < (std::uint64_t(1) << 32)) {
+			product *= primes[end];
+			++end;
+		}
+
+		std::uint64_t rem = 0;
+		for (int j = n.size() - 1; j >= 0; --j) {
+			rem = ((rem << 32) | n[j]) % product;
+		}
+
+		for (; i < end; ++i) {
+			residues[i] = std::uint32_t(rem % primes[i]);
+		}
+	}
+
+	return residues;
+}
+
+// Strong probable-prime (Miller-Rabin) test of an odd n > 3 to the base a,
+// where n - 1 = d * 2^s with d odd. All arithmetic is in Montgomery form.
+static bool strong_probable_prime(const Limbs& a, const Limbs& d, unsigned int s,
+	const Montgomery& ctx) {
+
+	Limbs minus_one = sub(ctx.m, ctx.one); // n - 1 in Montgomery form
+
+	Limbs x = window_pow(to_montgomery(mod(a, ctx.m), ctx), d, ctx.one,
+		[&ctx](const Limbs& y, const Limbs& z) { return mont_mul(y, z, ctx); });
+
+	if (x.empty() || compare(x, ctx.one) == 0 || compare(x, minus_one) == 0) {
+		return true;
+	}
+
+	for (unsigned int r = 1; r < s; ++r) {
+		x = mont_mul(x, x, ctx);
+		if (compare(x, minus_one) == 0) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// The Jacobi symbol (a / n) for an odd n, computed with quadratic reciprocity.
+static int jacobi(std::uint64_t a, std::uint64_t n) {
+	int result = 1;
+	a %= n;
+
+	while (a != 0) {
+		while ((a & 1) == 0) {
+			a >>= 1;
+			// (2 / n) = -1 exactly when n = 3 or 5 (mod 8)
+			if ((n & 7) == 3 || (n & 7) == 5) {
+				result = -result;
+			}
+		}
+
+		std::uint64_t t = a;
+		a = n;
+		n = t;
+
+		if ((a & 3) == 3 && (n & 3) == 3) {
+			result = -result;
+		}
+		a %= n;
+	}
+
+	return (n == 1) ? result : 0;
+}
+
+// The Jacobi symbol (d / n) for a small odd d (which may be negative) and a
+// large odd n.
+static int jacobi(std::int64_t d, const Limbs& n) {
+	int result = 1;
+
+	// (-1 / n) = -1 exactly when n = 3 (mod 4)
+	if (d < 0) {
+		d = -d;
+		if ((n[0] & 3) == 3) {
+			result = -result;
+		}
+	}
+
+	// Reciprocity: (d / n) = (n / d), unless d = n = 3 (mod 4)
+	if ((d & 3) == 3 && (n[0] & 3) == 3) {
+		result = -result;
+	}
+
+	Limbs q, r;
+	divmod(n, from_uint64(d), q, r);
+
+	return result * jacobi(to_uint64(r), std::uint64_t(d));
+}
+
+// Halve x modulo the odd m: if x is odd, x + m is even.
+static Limbs half_mod(const Limbs& x, const Limbs& m) {
+	if (!x.empty() && (x[0] & 1)) {
+		return shift_right(add(x, m), 1);
+	}
+	return shift_right(x, 1);
+}
+
+static Limbs add_mod(const Limbs& x, const Limbs& y, const Limbs& m) {
+	Limbs sum = add(x, y);
+	return (compare(sum, m) >= 0) ? sub(sum, m) : sum;
+}
+
+static Limbs sub_mod(const Limbs& x, const Limbs& y, const Limbs& m) {
+	return (compare(x, y) >= 0) ? sub(x, y) : sub(add(x, m), y);
+}
+
+// Strong Lucas probable-prime test of an odd n > 3 which is not a perfect
+// square, with parameters chosen by Selfridge's method: D is the first of
+// 5, -7, 9, -11, ... with (D / n) = -1, P = 1 and Q = (1 - D) / 4. Writing
+// n + 1 = d * 2^s with d odd, n passes if U_d = 0 or V_(d * 2^r) = 0 (mod n)
+// for some 0 <= r < s.
+static bool strong_lucas_probable_prime(const Limbs& n, const Montgomery& ctx) {
+	std::int64_t D = 5;
+	while (true) {
+		int j = jacobi(D, n);
+		if (j == -1) {
+			break;
+		}
+
+		// A common factor of D and n (unless n = |D| itself)
+		if (j == 0 && compare(from_uint64(D < 0 ? -D : D), n) != 0) {
+			return false;
+		}
+
+		D = (D > 0) ? -(D + 2) : -(D - 2);
+	}
+
+	std::int64_t Q = (1 - D) / 4;
+
+	// D and Q (mod n) in Montgomery form
+	Limbs D_mont = to_montgomery(from_uint64(D < 0 ? -D : D), ctx);
+	if (D < 0) D_mont = sub_mod(Limbs(), D_mont, n);
+	Limbs Q_mont = to_montgomery(from_uint64(Q < 0 ? -Q : Q), ctx);
+	if (Q < 0) Q_mont = sub_mod(Limbs(), Q_mont, n);
+
+	Limbs d = add(n, Limbs(1, 1));
+	unsigned int s = trailing_zeros(d);
+	d = shift_right(d, s);
+
+	// Climb to U_d, V_d and Q^d from the top bit of d down, using
+	//   U_2k = U_k V_k,  V_2k = V_k^2 - 2 Q^k,  Q^2k = (Q^k)^2
+	//   U_(k+1) = (U_k + V_k) / 2,  V_(k+1) = (D U_k + V_k) / 2.
+	// Montgomery form is linear, so adding and halving work as usual.
+	Limbs U = ctx.one;          // U_1 = 1
+	Limbs V = ctx.one;          // V_1 = P = 1
+	Limbs Qk = Q_mont;          // Q^1
+
+	for (int i = bit_length(d) - 2; i >= 0; --i) {
+		U = mont_mul(U, V, ctx);
+		V = sub_mod(mont_mul(V, V, ctx), add_mod(Qk, Qk, n), n);
+		Qk = mont_mul(Qk, Qk, ctx);
+
+		if (test_bit(d, i)) {
+			Limbs new_U = half_mod(add_mod(U, V, n), n);
+			V = half_mod(add_mod(mont_mul(D_mont, U, ctx), V, n), n);
+			U = new_U;
+			Qk = mont_mul(Qk, Q_mont, ctx);
+		}
+	}
+
+	if (U.empty() || V.empty()) {
+		return true;
+	}
+
+	for (unsigned int r = 1; r < s; ++r) {
+		V = sub_mod(mont_mul(V, V, ctx), add_mod(Qk, Qk, n), n);
+		Qk = mont_mul(Qk, Qk, ctx);
+		if (V.empty()) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// The tests of is_probable_prime which follow trial division, for an odd n
+// with no prime factor below 4096 (or which is itself below 4096^2).
+static bool passes_probable_prime_tests(const Limbs& n, unsigned int rounds) {
+	Montgomery ctx = make_montgomery(n);
+
+	Limbs d = sub(n, Limbs(1, 1));
+	unsigned int s = trailing_zeros(d);
+	d = shift_right(d, s);
+
+	// Baillie-PSW: a strong test to base 2 followed by a strong Lucas test.
+	if (!strong_probable_prime(Limbs(1, 2), d, s, ctx)) {
+		return false;
+	}
+
+	// The Lucas parameter search never ends for squares.
+	if (may_be_square(n) && compare(power(root(n, 2), 2), n) == 0) {
+		return false;
+	}
+
+	if (!strong_lucas_probable_prime(n, ctx)) {
+		return false;
+	}
+
+	// Extra Miller-Rabin rounds, using the small primes as bases.
+	const std::vector<std::uint32_t>& primes = small_primes();
+	for (unsigned int i = 0; i < rounds && i < primes.size(); ++i) {
+		if (!strong_probable_prime(Limbs(1, primes[i]), d, s, ctx)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool is_probable_prime(const Integer& val, unsigned int rounds) {
+	Limbs n = to_limbs(val);
+
+	if (n.empty() || (n.size() == 1 && n[0] < 4)) {
+		return n.size() == 1 && n[0] >= 2;
+	}
+
+	if ((n[0] & 1) == 0) {
+		return false;
+	}
+
+	// Trial division by the small primes
+	const std::vector<std::uint32_t>& primes = small_primes();
+	std::vector<std::uint32_t> residues = small_prime_residues(n);
+	for (std::size_t i = 0; i < primes.size(); ++i) {
+		if (residues[i] == 0) {
+			return n.size() == 1 && n[0] == primes[i];
+		}
+	}
+
+	// No factor below 4096, so anything below 4096^2 is prime.
+	if (n.size() == 1 && n[0] < 4096u * 4096u) {
+		return true;
+	}
+
+	return passes_probable_prime_tests(n, rounds);
+}
+
+Integer next_prime(const Integer& val) {
+	Limbs n = to_limbs(val);
+
+	if (n.empty() || (n.size() == 1 && n[0] < 2)) {
+		return Integer(2);
+	}
+
+	// The first odd candidate after val
+	Limbs start = add(n, Limbs(1, (n[0] & 1) ? 2 : 1));
+
+	// Small candidates are simply tested one by one.
+	while (start.size() == 1 && start[0] < 4096u * 4096u) {
+		if (is_probable_prime(from_limbs(start), 0)) {
+			return from_limbs(start);
+		}
+		start = add(start, Limbs(1, 2));
+	}
+
+	// Otherwise sieve a window of odd candidates start, start + 2, ... by all
+	// small primes at once, and only run the expensive tests on survivors.
+	const std::vector<std::uint32_t>& primes = small_primes();
+	const std::uint32_t window = 4096;
+	std::vector<bool> composite(window);
+
+	while (true) {
+		std::vector<std::uint32_t> residues = small_prime_residues(start);
+		composite.assign(window, false);
+
+		for (std::size_t i = 0; i < primes.size(); ++i) {
+			std::uint32_t p = primes[i];
+
+			// start + 2k = 0 (mod p) when k = -start / 2 (mod p)
+			std::uint64_t k = (std::uint64_t(p - residues[i]) % p) * ((p + 1) / 2) % p;
+			for (; k < window; k += p) {
+				composite[k] = true;
+			}
+		}
+
+		for (std::uint32_t k = 0; k < window; ++k) {
+			if (composite[k]) {
+				continue;
+			}
+
+			Limbs candidate = add(start, from_uint64(2 * std::uint64_t(k)));
+			if (passes_probable_prime_tests(candidate, 0)) {
+				return from_limbs(candidate);
+			}
+		}
+
+		start = add(start, from_uint64(2 * std::uint64_t(window)));
+	}
+}
+
+// Run f(0), f(1), ..., f(count - 1) on up to num_threads threads (0 means one
+// per hardware thread). Each thread repeatedly claims the next unprocessed
+// index, so uneven amounts of work per index still balance out. The threads
+// split num_threads between them as their thread budget, which the parallel
+// parts of f (a large mul, say) then stay within.
+template <typename Function>
+static void parallel_for(std::size_t count, unsigned int num_threads, Function f) {
+	if (num_threads == 0) {
+		num_threads = std::thread::hardware_concurrency();
+	}
+
+	unsigned int used_threads = (num_threads > count) ? count : num_threads;
+
+	if (used_threads <= 1) {
+		ThreadBudget budget(std::max(num_threads, 1u));
+		for (std::size_t i = 0; i < count; ++i) {
+			f(i);
+		}
+		return;
+	}
+
+	unsigned int share = num_threads / used_threads;
+	std::atomic<std::size_t> next(0);
+	auto worker = [&]() {
+		ThreadBudget budget(share);
+		for (std::size_t i = next++; i < count; i = next++) {
+			f(i);
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (unsigned int t = 1; t < used_threads; ++t) {
+		threads.push_back(std::thread(worker));
+	}
+
+	worker();
+
+	for (std::size_t t = 0; t < threads.size(); ++t) {
+		threads[t].join();
+	}
+}
+
+// Pollard's rho method with Brent's cycle detection, looking for a factor of
+// the odd composite n with the map x -> x^2 + c. Rather than taking a gcd
+// after every step, the differences |x - y| are multiplied together (mod n) in
+// batches of 128 and one gcd is taken per batch.
+// @return a non-trivial factor of n, or an empty vector if none was found
+// within max_steps steps
+static Limbs pollard_brent(const Limbs& n, const Montgomery& ctx, std::uint32_t c,
+	std::uint64_t max_steps) {
+
+	const std::uint64_t batch = 128;
+	Limbs c_mont = to_montgomery(Limbs(1, c), ctx);
+
+	auto f = [&](const Limbs& x) { return add_mod(mont_mul(x, x, ctx), c_mont, n); };
+
+	Limbs y = to_montgomery(Limbs(1, 2), ctx);
+	Limbs x, ys;
+	Limbs q = ctx.one;
+	Limbs g(1, 1);
+	std::uint64_t r = 1;
+
+	while (g.size() == 1 && g[0] == 1 && r <= max_steps) {
+		x = y;
+		for (std::uint64_t i = 0; i < r; ++i) {
+			y = f(y);
+		}
+
+		for (std::uint64_t k = 0; k < r && g.size() == 1 && g[0] == 1; k += batch) {
+			ys = y;
+			for (std::uint64_t i = 0; i < batch && i < r - k; ++i) {
+				y = f(y);
+				q = mont_mul(q, sub_mod(x, y, n), ctx);
+			}
+
+			// q is in Montgomery form, but R is coprime to n so the gcd is the same.
+			g = gcd(q, n);
+		}
+
+		r *= 2;
+	}
+
+	// The batch overshot (its product was a multiple of n), so step through it
+	// again one gcd at a time.
+	if (compare(g, n) == 0) {
+		do {
+			ys = f(ys);
+			g = gcd(sub_mod(x, ys, n), n);
+		} while (g.size() == 1 && g[0] == 1);
+	}
+
+	if ((g.size() == 1 && g[0] == 1) || compare(g, n) == 0) {
+		return Limbs();
+	}
+
+	return g;
+}
+
+// A point (X : Z) on a Montgomery curve, in Montgomery (number) form.
+struct CurvePoint {
+	Limbs X;
+	Limbs Z;
+};
+
+// Stage 1 of Lenstra's elliptic curve method on one curve. A random curve
+// from Suyama's family is chosen from sigma, and its starting point is
+// multiplied by every prime power up to B1 with the Montgomery ladder. If the
+// order of the curve modulo a prime p dividing n has only small factors, the
+// result is the point at infinity modulo p, so p divides its Z coordinate.
+// @return a non-trivial factor of n, or an empty vector
+static Limbs ecm_stage1(const Limbs& n, const Montgomery& ctx, std::uint32_t sigma,
+	std::uint32_t B1) {
+
+	// u = sigma^2 - 5, v = 4 sigma, and the curve constant
+	// (A + 2) / 4 = (v - u)^3 (3u + v) / (16 u^3 v), all modulo n.
+	Limbs s_limbs(1, sigma);
+	Limbs u = sub_mod(mod(mul(s_limbs, s_limbs), n), mod(Limbs(1, 5), n), n);
+	Limbs v = mod(mul(s_limbs, Limbs(1, 4)), n);
+	Limbs u3 = mod(mul(mod(mul(u, u), n), u), n);
+	Limbs v3 = mod(mul(mod(mul(v, v), n), v), n);
+
+	Limbs v_minus_u = sub_mod(v, u, n);
+	Limbs num = mod(mul(mod(mul(v_minus_u, v_minus_u), n), v_minus_u), n);
+	num = mod(mul(num, add_mod(mod(mul(u, Limbs(1, 3)), n), v, n)), n);
+	Limbs den = mod(mul(mod(mul(u3, v), n), Limbs(1, 16)), n);
+
+	Limbs den_inv;
+	if (!invert(den, n, den_inv)) {
+		// A failed inversion may itself reveal a factor.
+		Limbs g = gcd(den, n);
+		return (compare(g, n) == 0) ? Limbs() : g;
+	}
+
+	Limbs a24 = to_montgomery(mod(mul(num, den_inv), n), ctx);
+
+	auto dbl = [&](const CurvePoint& P) {
+		Limbs t1 = add_mod(P.X, P.Z, n);
+		t1 = mont_mul(t1, t1, ctx);
+		Limbs t2 = sub_mod(P.X, P.Z, n);
+		t2 = mont_mul(t2, t2, ctx);
+		Limbs t3 = sub_mod(t1, t2, n);
+
+		CurvePoint R;
+		R.X = mont_mul(t1, t2, ctx);
+		R.Z = mont_mul(t3, add_mod(t2, mont_mul(a24, t3, ctx), n), ctx);
+		return R;
+	};
+
+	// P + Q, given their difference D = P - Q
+	auto add_points = [&](const CurvePoint& P, const CurvePoint& Q,
+		const CurvePoint& D) {
+
+		Limbs s = mont_mul(sub_mod(P.X, P.Z, n), add_mod(Q.X, Q.Z, n), ctx);
+		Limbs t = mont_mul(add_mod(P.X, P.Z, n), sub_mod(Q.X, Q.Z, n), ctx);
+		Limbs plus = add_mod(s, t, n);
+		Limbs minus = sub_mod(s, t, n);
+
+		CurvePoint R;
+		R.X = mont_mul(D.Z, mont_mul(plus, plus, ctx), ctx);
+		R.Z = mont_mul(D.X, mont_mul(minus, minus, ctx), ctx);
+		return R;
+	};
+
+	// Multiply P by k with the Montgomery ladder, which keeps R1 - R0 = P.
+	auto ladder = [&](const CurvePoint& P, std::uint32_t k) {
+		CurvePoint R0 = P;
+		CurvePoint R1 = dbl(P);
+
+		int top = 31 - __builtin_clz(k);
+		for (int i = top - 1; i >= 0; --i) {
+			if ((k >> i) & 1) {
+				R0 = add_points(R1, R0, P);
+				R1 = dbl(R1);
+			}
+			else {
+				R1 = add_points(R1, R0, P);
+				R0 = dbl(R0);
+			}
+		}
+
+		return R0;
+	};
+
+	CurvePoint P;
+	P.X = to_montgomery(u3, ctx);
+	P.Z = to_montgomery(v3, ctx);
+
+	// Multiply by each prime power p^e <= B1.
+	std::vector<bool> composite(B1 + 1, false);
+	for (std::uint32_t p = 2; p <= B1; ++p) {
+		if (composite[p]) {
+			continue;
+		}
+		for (std::uint64_t j = std::uint64_t(p) * p; j <= B1; j += p) {
+			composite[j] = true;
+		}
+
+		for (std::uint64_t pe = p; pe <= B1; pe *= p) {
+			P = ladder(P, p);
+		}
+	}
+
+	Limbs g = gcd(P.Z, n);
+	if ((g.size() == 1 && g[0] == 1) || compare(g, n) == 0) {
+		return Limbs();
+	}
+
+	return g;
+}
+
+// Find a non-trivial factor of the odd composite n, which has no prime
+// factors below the trial division bound. Pollard-Brent rho is tried first,
+// since it quickly finds factors of up to about 40 bits; then ECM curves with
+// growing bounds are tried until one succeeds.
+static Limbs find_factor(const Limbs& n) {
+	Montgomery ctx = make_montgomery(n);
+
+	for (std::uint32_t c = 1; c <= 3; ++c) {
+		Limbs g = pollard_brent(n, ctx, c, std::uint64_t(1) << 16);
+		if (!g.empty()) {
+			return g;
+		}
+	}
+
+	std::uint32_t B1 = 2000;
+	for (std::uint32_t sigma = 6; ; ++sigma) {
+		Limbs g = ecm_stage1(n, ctx, sigma, B1);
+		if (!g.empty()) {
+			return g;
+		}
+
+		// Raise the bound every 25 curves to find larger factors.
+		if (sigma % 25 == 0 && B1 < 1000000) {
+			B1 = B1 * 5 / 2;
+		}
+	}
+}
+
+// Factor n into primes, appending them (unsorted) to factors.
+static void factor(const Limbs& val, std::vector<Limbs>& factors) {
+	Limbs n = val;
+
+	if (n.empty()) {
+		return;
+	}
+
+	// Factors of 2
+	unsigned int twos = trailing_zeros(n);
+	for (unsigned int i = 0; i < twos; ++i) {
+		factors.push_back(Limbs(1, 2));
+	}
+	n = shift_right(n, twos);
+
+	// Trial division by 3, 5 and then the numbers coprime to 30 (a "wheel"
+	// which skips all multiples of 2, 3 and 5).
+	const std::uint32_t bound = 1 << 16;
+	const std::uint32_t wheel[8] = { 4, 2, 4, 2, 4, 6, 2, 6 };
+	Limbs q, r;
+
+	std::uint32_t d = 3;
+	for (int step = -2; d < bound; ++step) {
+		Limbs d_limbs(1, d);
+		if (compare(mul(d_limbs, d_limbs), n) > 0) {
+			break;
+		}
+
+		divmod(n, d_limbs, q, r);
+		while (r.empty()) {
+			factors.push_back(d_limbs);
+			n.swap(q);
+			divmod(n, d_limbs, q, r);
+		}
+
+		// 3, 5, 7, then follow the wheel
+		d += (step < 0) ? 2 : wheel[step % 8];
+	}
+
+	// Split what remains with rho and ECM.
+	std::vector<Limbs> composites;
+	composites.push_back(n);
+
+	while (!composites.empty()) {
+		Limbs m = composites.back();
+		composites.pop_back();
+
+		if (m.size() == 1 && m[0] == 1) {
+			continue;
+		}
+
+		// Anything below bound^2 with no factor below bound is prime.
+		if (compare(m, from_uint64(std::uint64_t(bound) * bound)) < 0
+			|| passes_probable_prime_tests(m, 0)) {
+			factors.push_back(m);
+			continue;
+		}
+
+		Limbs root_m = root(m, 2);
+		if (compare(mul(root_m, root_m), m) == 0) {
+			composites.push_back(root_m);
+			composites.push_back(root_m);
+			continue;
+		}
+
+		Limbs g = find_factor(m);
+		divmod(m, g, q, r);
+		composites.push_back(g);
+		composites.push_back(q);
+	}
+}
+
+std::vector<Integer> factor(const Integer& val) {
+	std::vector<Limbs> factors;
+	factor(to_limbs(val), factors);
+
+	std::sort(factors.begin(), factors.end(),
+		[](const Limbs& a, const Limbs& b) { return compare(a, b) < 0; });
+
+	std::vector<Integer> primes;
+	for (std::size_t i = 0; i < factors.size(); ++i) {
+		primes.push_back(from_limbs(factors[i]));
+	}
+
+	return primes;
+}
+
+std::vector<std::vector<Integer> > factor_all(const std::vector<Integer>& values,
+	unsigned int num_threads) {
+
+	std::vector<std::vector<Integer> > results(values.size());
+
+	parallel_for(values.size(), num_threads,
+		[&](std::size_t i) { results[i] = factor(values[i]); });
+
+	return results;
+}
+
+IntegerView::IntegerView() : limbs_(nullptr), length_(0), neg_(false) {
+}
+
+IntegerView::IntegerView(const std::uint32_t* limbs, std::size_t length, bool negative)
+	: limbs_(limbs), length_(length), neg_(negative && length != 0) {
+}
+
+Integer IntegerView::to_integer() const {
+	return from_limbs(Limbs(limbs_, limbs_ + length_));
+}
+
+SignedInteger IntegerView::to_signed_integer() const {
+	Integer mag = to_integer();
+	SignedInteger val(mag);
+
+	if (neg_) {
+		val.negate();
+	}
+
+	return val;
+}
+
+IntegerArray::IntegerArray() : offsets_(1, 0) {
+}
+
+void IntegerArray::reserve(std::size_t count, std::size_t num_limbs) {
+	limbs_.reserve(num_limbs);
+	offsets_.reserve(count + 1);
+	negative_.reserve(count);
+}
+
+void IntegerArray::clear() {
+	limbs_.clear();
+	offsets_.resize(1);
+	negative_.clear();
+}
+
+void IntegerArray::push_back(const Integer& val) {
+	Limbs mag = to_limbs(val);
+	push_back(IntegerView(mag.data(), mag.size(), false));
+}
+
+void IntegerArray::push_back(const SignedInteger& val) {
+	Limbs mag = to_limbs(val.magnitude());
+	push_back(IntegerView(mag.data(), mag.size(), val.is_negative()));
+}
+
+void IntegerArray::push_back(const IntegerView& val) {
+
+	// val may be a view of an element of this array, whose words would move
+	// if limbs_ has to grow.
+	if (limbs_.size() + val.length() > limbs_.capacity()) {
+		Limbs mag(val.limbs(), val.limbs() + val.length());
+		limbs_.insert(limbs_.end(), mag.begin(), mag.end());
+	}
+	else {
+		limbs_.insert(limbs_.end(), val.limbs(), val.limbs() + val.length());
+	}
+	offsets_.push_back(limbs_.size());
+	negative_.push_back(val.is_negative());
+}
+
+IntegerView IntegerArray::operator[](std::size_t index) const {
+	return IntegerView(limbs_.data() + offsets_[index],
+		offsets_[index + 1] - offsets_[index], negative_[index]);
+}
+
+// A value with a sign, for the reductions below. The value 0 is never
+// negative.
+struct SignedLimbs {
+	Limbs mag;
+	bool neg;
+};
+
+// Add the value with magnitude mag (negative if neg) to acc.
+static void add_signed(SignedLimbs& acc, const Limbs& mag, bool neg) {
+	if (acc.neg == neg) {
+		acc.mag = add(acc.mag, mag);
+	}
+	else if (compare(acc.mag, mag) >= 0) {
+		acc.mag = sub(acc.mag, mag);
+	}
+	else {
+		acc.mag = sub(mag, acc.mag);
+		acc.neg = neg;
+	}
+
+	if (acc.mag.empty()) {
+		acc.neg = false;
+	}
+}
+
+// Multiply factors[begin, end) (end > begin) as a balanced tree into r, which
+// must hold as many limbs as the factors together; scratch must hold as many
+// again. Both halves are written side by side into r and their product goes
+// to scratch and back, so each level reuses the same two regions.
+// @return the length of the product
+static std::size_t product_tree(std::uint32_t* r, const std::vector<Limbs>& factors,
+	std::size_t begin, std::size_t end, std::uint32_t* scratch) {
+
+	if (end - begin == 1) {
+		std::copy(factors[begin].begin(), factors[begin].end(), r);
+		return factors[begin].size();
+	}
+
+	std::size_t middle = begin + (end - begin) / 2;
+	std::size_t left = product_tree(r, factors, begin, middle, scratch);
+	if (left == 0) {
+		return 0;
+	}
+
+	std::size_t right = product_tree(r + left, factors, middle, end, scratch);
+	if (right == 0) {
+		return 0;
+	}
+
+	mul_n(scratch, r, left, r + left, right);
+	std::size_t n = trimmed_length(scratch, left + right);
+	std::copy(scratch, scratch + n, r);
+
+	return n;
+}
+
+// Multiply the factors as a balanced tree, so that both operands of every
+// multiplication have about the same size and the large ones get Karatsuba
+// (and threads) instead of a long chain of unbalanced products. The partial
+// products are kept on the scratch stack; only the result is allocated.
+static Limbs product_tree(const std::vector<Limbs>& factors) {
+	if (factors.empty()) {
+		return Limbs(1, 1);
+	}
+
+	std::size_t total = 0;
+	for (std::size_t i = 0; i < factors.size(); ++i) {
+		total += factors[i].size();
+	}
+
+	Limbs prod(total);
+	ScratchFrame frame(total);
+	prod.resize(product_tree(prod.data(), factors, 0, factors.size(), frame.data()));
+
+	return prod;
+}
+
+// Compute the sum and/or the product of count values; get(i, mag) stores the
+// magnitude of value i in mag and returns true if value i is negative. The
+// values are cut into a few blocks per thread; idle threads keep taking the
+// next unprocessed block, so a thread that gets small values does not wait
+// for one that gets large ones. Each block is reduced on its own, and the
+// partial products are then multiplied together as a balanced tree.
+template <typename Getter>
+static void reduce_values(std::size_t count, Getter get, unsigned int num_threads,
+	SignedLimbs* sum, SignedLimbs* product) {
+
+	if (num_threads == 0) {
+		num_threads = available_threads();
+	}
+
+	std::size_t num_blocks = std::min<std::size_t>(count, 4 * std::size_t(num_threads));
+	std::vector<SignedLimbs> block_sums(num_blocks, SignedLimbs{ Limbs(), false });
+	std::vector<Limbs> block_products(num_blocks);
+	std::vector<std::size_t> block_negatives(num_blocks, 0);
+
+	parallel_for(num_blocks, num_threads, [&](std::size_t block) {
+		std::size_t begin = count * block / num_blocks;
+		std::size_t end = count * (block + 1) / num_blocks;
+
+		std::vector<Limbs> mags(end - begin);
+		for (std::size_t i = begin; i < end; ++i) {
+			bool neg = get(i, mags[i - begin]);
+
+			if (sum) {
+				add_signed(block_sums[block], mags[i - begin], neg);
+			}
+			if (neg) {
+				++block_negatives[block];
+			}
+		}
+
+		if (product) {
+			block_products[block] = product_tree(mags);
+		}
+	});
+
+	if (sum) {
+		*sum = SignedLimbs{ Limbs(), false };
+		for (std::size_t block = 0; block < num_blocks; ++block) {
+			add_signed(*sum, block_sums[block].mag, block_sums[block].neg);
+		}
+	}
+
+	if (product) {
+		std::size_t negatives = 0;
+		for (std::size_t block = 0; block < num_blocks; ++block) {
+			negatives += block_negatives[block];
+		}
+
+		ThreadBudget budget(num_threads);
+		product->mag = product_tree(block_products);
+		product->neg = (negatives % 2 == 1) && !product->mag.empty();
+	}
+}
+
+static void reduce_values(const std::vector<SignedInteger>& values, unsigned int num_threads,
+	SignedLimbs* sum, SignedLimbs* product) {
+
+	reduce_values(values.size(), [&](std::size_t i, Limbs& mag) {
+		mag = to_limbs(values[i].magnitude());
+		return values[i].is_negative();
+	}, num_threads, sum, product);
+}
+
+static void reduce_values(const IntegerArray& values, unsigned int num_threads,
+	SignedLimbs* sum, SignedLimbs* product) {
+
+	reduce_values(values.size(), [&](std::size_t i, Limbs& mag) {
+		IntegerView val = values[i];
+		mag.assign(val.limbs(), val.limbs() + val.length());
+		return val.is_negative();
+	}, num_threads, sum, product);
+}
+
+// Convert a signed value on limbs back to a SignedInteger.
+static SignedInteger from_signed_limbs(const SignedLimbs& val) {
+	Integer mag = from_limbs(val.mag);
+	SignedInteger result(mag);
+
+	if (val.neg) {
+		result.negate();
+	}
+
+	return result;
+}
+
+SignedInteger parallel_sum(const std::vector<SignedInteger>& values,
+	unsigned int num_threads) {
+
+	SignedLimbs sum;
+	reduce_values(values, num_threads, &sum, nullptr);
+	return from_signed_limbs(sum);
+}
+
+SignedInteger parallel_product(const std::vector<SignedInteger>& values,
+	unsigned int num_threads) {
+
+	SignedLimbs product;
+	reduce_values(values, num_threads, nullptr, &product);
+	return from_signed_limbs(product);
+}
+
+void parallel_sum_product(const std::vector<SignedInteger>& values, SignedInteger& sum,
+	SignedInteger& product, unsigned int num_threads) {
+
+	SignedLimbs sum_limbs, product_limbs;
+	reduce_values(values, num_threads, &sum_limbs, &product_limbs);
+	sum = from_signed_limbs(sum_limbs);
+	product = from_signed_limbs(product_limbs);
+}
+
+SignedInteger parallel_sum(const IntegerArray& values, unsigned int num_threads) {
+	SignedLimbs sum;
+	reduce_values(values, num_threads, &sum, nullptr);
+	return from_signed_limbs(sum);
+}
+
+SignedInteger parallel_product(const IntegerArray& values, unsigned int num_threads) {
+	SignedLimbs product;
+	reduce_values(values, num_threads, nullptr, &product);
+	return from_signed_limbs(product);
+}
+
+void parallel_sum_product(const IntegerArray& values, SignedInteger& sum,
+	SignedInteger& product, unsigned int num_threads) {
+
+	SignedLimbs sum_limbs, product_limbs;
+	reduce_values(values, num_threads, &sum_limbs, &product_limbs);
+	sum = from_signed_limbs(sum_limbs);
+	product = from_signed_limbs(product_limbs);
+}
+
+enum BatchOp { batch_add, batch_sub, batch_mul };
+
+// Batches are processed in chunks of this many elements. A chunk whose
+// operands are all small is computed on arrays of machine words.
+static const std::size_t batch_chunk = 256;
+
+// Smaller batches are not worth starting threads for.
+static const std::size_t batch_parallel_min = 4096;
+
+// Compute out = a op b for one pair of arbitrary size. Each operation is
+// symmetric (subtraction gives |a - b|), so when out is b the roles of a and
+// b can be exchanged instead of copying.
+static void batch_element(BatchOp op, const Integer& a, const Integer& b, Integer& out) {
+	const Integer& other = (&out == &b) ? a : b;
+
+	if (&out != &a && &out != &b) {
+		out.set_value(a);
+	}
+
+	switch (op) {
+	case batch_add:
+		out += other;
+		break;
+	case batch_sub:
+		out -= other;
+		break;
+	case batch_mul:
+		out *= other;
+		break;
+	}
+}
+
+// Tell if all the operands a[i], b[i] for begin <= i < end fit in machine
+// words for op (sums below 2^64, products of values below 2^32).
+static bool batch_fits_words(BatchOp op, const Integer* a, const Integer* b,
+	std::size_t begin, std::size_t end) {
+
+	int max_bits = (op == batch_mul) ? 32 : 63;
+	for (std::size_t i = begin; i < end; ++i) {
+		if (a[i].size() > max_bits || b[i].size() > max_bits) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Compute x[i - begin] = a[i] op b[i] for begin <= i < end (at most
+// batch_chunk elements, all fitting in words). The operands are gathered
+// into one array each and combined with a plain loop over the arrays, which
+// the compiler turns into SIMD code.
+static void batch_words(BatchOp op, const Integer* a, const Integer* b,
+	std::size_t begin, std::size_t end, std::uint64_t* x) {
+
+	std::uint64_t y[batch_chunk];
+	std::size_t count = end - begin;
+
+	for (std::size_t i = 0; i < count; ++i) {
+		x[i] = a[begin + i].get_uint64_value();
+		y[i] = b[begin + i].get_uint64_value();
+	}
+
+	switch (op) {
+	case batch_add:
+		for (std::size_t i = 0; i < count; ++i) {
+			x[i] += y[i];
+		}
+		break;
+	case batch_sub:
+		for (std::size_t i = 0; i < count; ++i) {
+			x[i] = (x[i] >= y[i]) ? x[i] - y[i] : y[i] - x[i];
+		}
+		break;
+	case batch_mul:
+		for (std::size_t i = 0; i < count; ++i) {
+			x[i] *= y[i];
+		}
+		break;
+	}
+}
+
+// Compute out[i] = a[i] op b[i] for begin <= i < end (at most batch_chunk
+// elements), on machine words if all the operands fit.
+static void batch_range(BatchOp op, const Integer* a, const Integer* b, Integer* out,
+	std::size_t begin, std::size_t end) {
+
+	if (!batch_fits_words(op, a, b, begin, end)) {
+		for (std::size_t i = begin; i < end; ++i) {
+			batch_element(op, a[i], b[i], out[i]);
+		}
+		return;
+	}
+
+	std::uint64_t x[batch_chunk];
+	batch_words(op, a, b, begin, end, x);
+
+	for (std::size_t i = begin; i < end; ++i) {
+		out[i].set_uint64_value(x[i - begin]);
+	}
+}
+
+#ifdef INTEGER_USE_PMR
+
+// Compute a op b on limbs, without touching any Integer's storage.
+static Limbs batch_limbs(BatchOp op, const Integer& a, const Integer& b) {
+	Limbs x = to_limbs(a);
+	Limbs y = to_limbs(b);
+
+	switch (op) {
+	case batch_add:
+		return add(x, y);
+	case batch_sub:
+		return (compare(x, y) >= 0) ? sub(x, y) : sub(y, x);
+	case batch_mul:
+		return mul(x, y);
+	}
+
+	return Limbs();
+}
+
+// The elements of out may allocate from the caller's memory resource, which
+// need not be thread-safe (an IntegerPool is not). So the worker threads
+// only compute the results, as words or limbs, and the calling thread then
+// stores all of them into out.
+static void batch_on_threads(BatchOp op, const Integer* a, const Integer* b, Integer* out,
+	std::size_t count, unsigned int num_threads) {
+
+	std::size_t num_chunks = (count + batch_chunk - 1) / batch_chunk;
+	std::vector<std::uint64_t> words(count);
+	std::vector<Limbs> limbs(count);
+	std::vector<char> fits_words(num_chunks);
+
+	parallel_for(num_chunks, num_threads, [&](std::size_t chunk) {
+		std::size_t begin = chunk * batch_chunk;
+		std::size_t end = std::min(begin + batch_chunk, count);
+
+		fits_words[chunk] = batch_fits_words(op, a, b, begin, end);
+		if (fits_words[chunk]) {
+			batch_words(op, a, b, begin, end, &words[begin]);
+			return;
+		}
+
+		for (std::size_t i = begin; i < end; ++i) {
+			limbs[i] = batch_limbs(op, a[i], b[i]);
+		}
+	});
+
+	for (std::size_t i = 0; i < count; ++i) {
+		if (fits_words[i / batch_chunk]) {
+			out[i].set_uint64_value(words[i]);
+		}
+		else {
+			out[i].set_value(from_limbs(limbs[i]));
+		}
+	}
+}
+
+#endif
+
+static void batch(BatchOp op, const Integer* a, const Integer* b, Integer* out,
+	std::size_t count, unsigned int num_threads) {
+
+	if (num_threads == 0) {
+		num_threads = available_threads();
+	}
+
+	if (count < batch_parallel_min) {
+		num_threads = 1;
+	}
+
+#ifdef INTEGER_USE_PMR
+	if (num_threads > 1) {
+		batch_on_threads(op, a, b, out, count, num_threads);
+		return;
+	}
+#endif
+
+	std::size_t num_chunks = (count + batch_chunk - 1) / batch_chunk;
+	parallel_for(num_chunks, num_threads, [&](std::size_t chunk) {
+		std::size_t begin = chunk * batch_chunk;
+		batch_range(op, a, b, out, begin, std::min(begin + batch_chunk, count));
+	});
+}
+
+void add_batch(const Integer* a, const Integer* b, Integer* out, std::size_t count,
+	unsigned int num_threads) {
+
+	batch(batch_add, a, b, out, count, num_threads);
+}
+
+void sub_batch(const Integer* a, const Integer* b, Integer* out, std::size_t count,
+	unsigned int num_threads) {
+
+	batch(batch_sub, a, b, out, count, num_threads);
+}
+
+void mul_batch(const Integer* a, const Integer* b, Integer* out, std::size_t count,
+	unsigned int num_threads) {
+
+	batch(batch_mul, a, b, out, count, num_threads);
+}
+
+// Copy the words of a view into a limb value.
+static Limbs view_limbs(const IntegerView& val) {
+	return Limbs(val.limbs(), val.limbs() + val.length());
+}
+
+// Compare the absolute values of two views.
+// @return -1, 0 or 1 if |lhs| is less than, equal to or greater than |rhs|.
+static int compare_magnitude(const IntegerView& lhs, const IntegerView& rhs) {
+	if (lhs.length() != rhs.length()) {
+		return (lhs.length() < rhs.length()) ? -1 : 1;
+	}
+
+	for (std::size_t i = lhs.length(); i-- > 0; ) {
+		if (lhs.limbs()[i] != rhs.limbs()[i]) {
+			return (lhs.limbs()[i] < rhs.limbs()[i]) ? -1 : 1;
+		}
+	}
+
+	return 0;
+}
+
+int compare(const IntegerView& lhs, const IntegerView& rhs) {
+	if (lhs.is_negative() != rhs.is_negative()) {
+		return lhs.is_negative() ? -1 : 1;
+	}
+
+	int result = compare_magnitude(lhs, rhs);
+	return lhs.is_negative() ? -result : result;
+}
+
+bool operator==(const IntegerView& lhs, const IntegerView& rhs) {
+	return compare(lhs, rhs) == 0;
+}
+
+bool operator!=(const IntegerView& lhs, const IntegerView& rhs) {
+	return compare(lhs, rhs) != 0;
+}
+
+bool operator<(const IntegerView& lhs, const IntegerView& rhs) {
+	return compare(lhs, rhs) < 0;
+}
+
+bool operator<=(const IntegerView& lhs, const IntegerView& rhs) {
+	return compare(lhs, rhs) <= 0;
+}
+
+bool operator>(const IntegerView& lhs, const IntegerView& rhs) {
+	return compare(lhs, rhs) > 0;
+}
+
+bool operator>=(const IntegerView& lhs, const IntegerView& rhs) {
+	return compare(lhs, rhs) >= 0;
+}
+
+SignedInteger operator+(const IntegerView& lhs, const IntegerView& rhs) {
+	SignedLimbs sum = { view_limbs(lhs), lhs.is_negative() };
+	add_signed(sum, view_limbs(rhs), rhs.is_negative());
+	return from_signed_limbs(sum);
+}
+
+SignedInteger operator-(const IntegerView& lhs, const IntegerView& rhs) {
+
+	// Subtraction is just adding the opposite!
+	SignedLimbs difference = { view_limbs(lhs), lhs.is_negative() };
+	add_signed(difference, view_limbs(rhs), !rhs.is_negative());
+	return from_signed_limbs(difference);
+}
+
+SignedInteger operator*(const IntegerView& lhs, const IntegerView& rhs) {
+	SignedLimbs product = { mul(view_limbs(lhs), view_limbs(rhs)), false };
+	product.neg = (lhs.is_negative() != rhs.is_negative()) && !product.mag.empty();
+	return from_signed_limbs(product);
+}
+
+SignedInteger operator/(const IntegerView& lhs, const IntegerView& rhs) {
+
+	// Check for division by 0!
+	if (rhs.is_zero()) {
+		std::cout << "Division by 0 error!" << std::endl;
+		return lhs.to_signed_integer();
+	}
+
+	SignedLimbs quotient;
+	Limbs r;
+	divmod(view_limbs(lhs), view_limbs(rhs), quotient.mag, r);
+	quotient.neg = (lhs.is_negative() != rhs.is_negative()) && !quotient.mag.empty();
+	return from_signed_limbs(quotient);
+}
+
+SignedInteger operator%(const IntegerView& lhs, const IntegerView& rhs) {
+
+	// Check for modulus by 0!
+	if (rhs.is_zero()) {
+		std::cout << "Modulus by 0 error!" << std::endl;
+		return lhs.to_signed_integer();
+	}
+
+	SignedLimbs remainder;
+	Limbs q;
+	divmod(view_limbs(lhs), view_limbs(rhs), q, remainder.mag);
+	remainder.neg = lhs.is_negative() && !remainder.mag.empty();
+	return from_signed_limbs(remainder);
+}
+
+Integer gcd(const IntegerView& a, const IntegerView& b) {
+	return from_limbs(gcd(view_limbs(a), view_limbs(b)));
+}
+
+Integer powmod(const IntegerView& base, const IntegerView& exp, const IntegerView& mod) {
+
+	// Check for modulus by 0!
+	if (mod.is_zero()) {
+		std::cout << "Modulus by 0 error!" << std::endl;
+		return Integer(0);
+	}
+
+	// A negative base is replaced by its (non-negative) residue mod m.
+	Limbs m = view_limbs(mod);
+	Limbs b = ::mod(view_limbs(base), m);
+	if (base.is_negative() && !b.empty()) {
+		b = sub(m, b);
+	}
+
+	return from_limbs(powmod(b, view_limbs(exp), m));
+}
+
+// Negate the two's complement value a in place (invert and add 1).
+static void negate_words(Limbs& a) {
+	std::uint32_t carry = 1;
+	for (std::size_t i = 0; i < a.size(); ++i) {
+		a[i] = ~a[i] + carry;
+		carry = (carry != 0 && a[i] == 0) ? 1 : 0;
+	}
+}
+
+// Return the magnitude of the two's complement value a.
+static Limbs twos_complement_magnitude(const Limbs& a) {
+	Limbs mag = a;
+	if (!mag.empty() && (mag.back() >> 31) != 0) {
+		negate_words(mag);
+	}
+
+	trim(mag);
+	return mag;
+}
+
+// Turn the magnitude mag into a two's complement value (negative if neg).
+static void make_twos_complement(Limbs& mag, bool neg) {
+	trim(mag);
+	if (mag.empty()) {
+		return;
+	}
+
+	// Leave room for the sign bit.
+	if ((mag.back() >> 31) != 0) {
+		mag.push_back(0);
+	}
+
+	if (neg) {
+		negate_words(mag);
+	}
+}
+
+TwosComplementInteger::TwosComplementInteger() {}
+
+TwosComplementInteger::TwosComplementInteger(std::int64_t val) {
+	limbs_.push_back(std::uint32_t(val));
+	limbs_.push_back(std::uint32_t(std::uint64_t(val) >> 32));
+	normalize();
+}
+
+TwosComplementInteger::TwosComplementInteger(const Integer& val) : limbs_(to_limbs(val)) {
+	make_twos_complement(limbs_, false);
+}
+
+TwosComplementInteger::TwosComplementInteger(const SignedInteger& val)
+	: limbs_(to_limbs(val.magnitude())) {
+	make_twos_complement(limbs_, val.is_negative());
+	normalize();
+}
+
+SignedInteger TwosComplementInteger::to_signed_integer() const {
+	SignedLimbs val = { twos_complement_magnitude(limbs_), is_negative() };
+	return from_signed_limbs(val);
+}
+
+std::string TwosComplementInteger::binary_string() const {
+	return to_signed_integer().binary_string();
+}
+
+std::string TwosComplementInteger::decimal_string() const {
+	return to_signed_integer().decimal_string();
+}
+
+void TwosComplementInteger::normalize() {
+	while (!limbs_.empty()) {
+		std::uint32_t top = limbs_.back();
+
+		// A single word is only redundant if the value is 0.
+		if (limbs_.size() == 1) {
+			if (top == 0) {
+				limbs_.pop_back();
+			}
+			break;
+		}
+
+		// The top word is redundant if it only repeats the sign bit of the
+		// word below it.
+		std::uint32_t sign = (limbs_[limbs_.size() - 2] >> 31) ? 0xFFFFFFFFu : 0;
+		if (top != sign) {
+			break;
+		}
+
+		limbs_.pop_back();
+	}
+}
+
+void TwosComplementInteger::negate() {
+	bool neg = !is_negative();
+	limbs_ = twos_complement_magnitude(limbs_);
+	make_twos_complement(limbs_, neg);
+	normalize();
+}
+
+void TwosComplementInteger::add(const TwosComplementInteger& rhs, bool subtract) {
+	std::size_t m = rhs.limbs_.size();
+	std::uint32_t rhs_sign = rhs.is_negative() ? 0xFFFFFFFFu : 0;
+	std::uint32_t sign = is_negative() ? 0xFFFFFFFFu : 0;
+
+	// Sign-extend this value by one word past the longer operand, which
+	// always has room for the result. (If rhs is this value, it is extended
+	// too, which does not change it.)
+	limbs_.resize(std::max(limbs_.size(), m) + 1, sign);
+
+	std::uint32_t* r = limbs_.data();
+	const std::uint32_t* b = rhs.limbs_.data();
+	std::size_t n = limbs_.size();
+
+	// Past the end of rhs, carry on with its sign word. The carry out of the
+	// top word is simply dropped.
+	if (subtract) {
+		std::uint32_t borrow = kernels()->sub_n(r, r, b, m, 0);
+		for (std::size_t i = m; i < n; ++i) {
+			std::uint64_t diff = std::uint64_t(r[i]) - rhs_sign - borrow;
+			r[i] = std::uint32_t(diff);
+			borrow = std::uint32_t(diff >> 63);
+		}
+	}
+	else {
+		std::uint32_t carry = kernels()->add_n(r, r, b, m, 0);
+		for (std::size_t i = m; i < n; ++i) {
+			std::uint64_t sum = std::uint64_t(r[i]) + rhs_sign + carry;
+			r[i] = std::uint32_t(sum);
+			carry = std::uint32_t(sum >> 32);
+		}
+	}
+
+	normalize();
+}
+
+TwosComplementInteger& TwosComplementInteger::operator+=(const TwosComplementInteger& rhs) {
+	add(rhs, false);
+	return *this;
+}
+
+TwosComplementInteger& TwosComplementInteger::operator-=(const TwosComplementInteger& rhs) {
+	add(rhs, true);
+	return *this;
+}
+
+TwosComplementInteger& TwosComplementInteger::operator*=(const TwosComplementInteger& rhs) {
+	bool neg = is_negative() != rhs.is_negative();
+	limbs_ = mul(twos_complement_magnitude(limbs_), twos_complement_magnitude(rhs.limbs_));
+	make_twos_complement(limbs_, neg);
+	normalize();
+
+	return *this;
+}
+
+TwosComplementInteger& TwosComplementInteger::operator/=(const TwosComplementInteger& rhs) {
+	divide(rhs, false);
+	return *this;
+}
+
+TwosComplementInteger& TwosComplementInteger::operator%=(const TwosComplementInteger& rhs) {
+	divide(rhs, true);
+	return *this;
+}
+
+void TwosComplementInteger::divide(const TwosComplementInteger& rhs, bool remainder) {
+
+	// Check for division by 0!
+	if (rhs.is_zero()) {
+		std::cout << (remainder ? "Modulus" : "Division") << " by 0 error!" << std::endl;
+		return;
+	}
+
+	// The quotient is negative if the signs differ; the remainder has the
+	// sign of this value.
+	bool neg = remainder ? is_negative() : (is_negative() != rhs.is_negative());
+	Limbs q, r;
+	divmod(twos_complement_magnitude(limbs_), twos_complement_magnitude(rhs.limbs_), q, r);
+
+	limbs_.swap(remainder ? r : q);
+	make_twos_complement(limbs_, neg);
+	normalize();
+}
+
+TwosComplementInteger& TwosComplementInteger::operator++() {
+	static const TwosComplementInteger one(1);
+	add(one, false);
+	return *this;
+}
+
+TwosComplementInteger& TwosComplementInteger::operator--() {
+	static const TwosComplementInteger one(1);
+	add(one, true);
+	return *this;
+}
+
+TwosComplementInteger operator+(TwosComplementInteger lhs, const TwosComplementInteger& rhs) {
+	lhs += rhs;
+	return lhs;
+}
+
+TwosComplementInteger operator-(TwosComplementInteger lhs, const TwosComplementInteger& rhs) {
+	lhs -= rhs;
+	return lhs;
+}
+
+TwosComplementInteger operator*(TwosComplementInteger lhs, const TwosComplementInteger& rhs) {
+	lhs *= rhs;
+	return lhs;
+}
+
+TwosComplementInteger operator/(TwosComplementInteger lhs, const TwosComplementInteger& rhs) {
+	lhs /= rhs;
+	return lhs;
+}
+
+TwosComplementInteger operator%(TwosComplementInteger lhs, const TwosComplementInteger& rhs) {
+	lhs %= rhs;
+	return lhs;
+}
+
+TwosComplementInteger operator-(TwosComplementInteger val) {
+	val.negate();
+	return val;
+}
+
+int compare(const TwosComplementInteger& lhs, const TwosComplementInteger& rhs) {
+	bool lhs_negative = lhs.is_negative();
+	if (lhs_negative != rhs.is_negative()) {
+		return lhs_negative ? -1 : 1;
+	}
+
+	// With no redundant sign words, a longer value has the larger magnitude,
+	// so it is larger if positive and smaller if negative.
+	const Limbs& a = lhs.limbs_;
+	const Limbs& b = rhs.limbs_;
+	if (a.size() != b.size()) {
+		return ((a.size() > b.size()) != lhs_negative) ? 1 : -1;
+	}
+
+	// Words of the same length and sign compare like unsigned numbers.
+	return compare(a, b);
+}
+
+bool operator==(const TwosComplementInteger& lhs, const TwosComplementInteger& rhs) {
+	return compare(lhs, rhs) == 0;
+}
+
+bool operator!=(const TwosComplementInteger& lhs, const TwosComplementInteger& rhs) {
+	return compare(lhs, rhs) != 0;
+}
+
+bool operator<(const TwosComplementInteger& lhs, const TwosComplementInteger& rhs) {
+	return compare(lhs, rhs) < 0;
+}
+
+bool operator<=(const TwosComplementInteger& lhs, const TwosComplementInteger& rhs) {
+	return compare(lhs, rhs) <= 0;
+}
+
+bool operator>(const TwosComplementInteger& lhs, const TwosComplementInteger& rhs) {
+	return compare(lhs, rhs) > 0;
+}
+
+bool operator>=(const TwosComplementInteger& lhs, const TwosComplementInteger& rhs) {
+	return compare(lhs, rhs) >= 0;
+}
+
+std::ostream& operator << (std::ostream& os, const TwosComplementInteger& val) {
+	os << val.decimal_string();
+	return os;
+}
+
+IntegerRef::IntegerRef(const Integer& val) : val_(&val), neg_(false) {}
+
+IntegerRef::IntegerRef(const SignedInteger& val) : val_(&val.magnitude()), neg_(val.is_negative()) {}
+
+void IntegerRef::collect(std::vector<IntegerTerm>& terms, std::deque<SignedInteger>& /* temps */,
+	bool negate) const {
+
+	IntegerTerm term = { val_, nullptr, neg_ != negate };
+	terms.push_back(term);
+}
+
+const Integer* IntegerRef::factor(std::deque<SignedInteger>& /* temps */, bool& negative) const {
+	negative = neg_;
+	return val_;
+}
+
+// Add the word w to r at position offset, carrying as far as needed.
+static void add_word_at(Limbs& r, std::uint32_t w, std::size_t offset) {
+	for (std::size_t i = offset; w != 0; ++i) {
+		r[i] += w;
+		w = (r[i] < w) ? 1 : 0;
+	}
+}
+
+SignedInteger evaluate_terms(const std::vector<IntegerTerm>& terms) {
+
+	// Convert every distinct operand to limbs once (a * a, or an operand
+	// that appears in several terms, is only converted once).
+	std::vector<const Integer*> operands;
+	std::vector<Limbs> operand_limbs;
+	std::vector<std::size_t> lhs_index(terms.size()), rhs_index(terms.size());
+
+	auto index_of = [&](const Integer* val) {
+		std::size_t i = std::find(operands.begin(), operands.end(), val) - operands.begin();
+		if (i == operands.size()) {
+			operands.push_back(val);
+			operand_limbs.push_back(to_limbs(*val));
+		}
+		return i;
+	};
+
+	// The sums of the positive terms and of the negative terms need at most
+	// one limb more than the largest term (for up to 2^32 terms).
+	std::size_t single_width = 0;
+	std::size_t width = 0;
+	for (std::size_t t = 0; t < terms.size(); ++t) {
+		lhs_index[t] = index_of(terms[t].lhs);
+		std::size_t term_width = operand_limbs[lhs_index[t]].size();
+
+		if (terms[t].rhs) {
+			rhs_index[t] = index_of(terms[t].rhs);
+			term_width += operand_limbs[rhs_index[t]].size();
+		}
+		else {
+			single_width = std::max(single_width, term_width + 1);
+		}
+
+		width = std::max(width, term_width + 1);
+	}
+
+	// sums[0] accumulates the positive terms and sums[1] the negative ones.
+	Limbs sums[2] = { Limbs(width, 0), Limbs(width, 0) };
+
+	// Add all the single-value terms limb by limb in one carry pass.
+	std::uint64_t carry[2] = { 0, 0 };
+	for (std::size_t i = 0; i < single_width; ++i) {
+		for (std::size_t t = 0; t < terms.size(); ++t) {
+			const Limbs& x = operand_limbs[lhs_index[t]];
+			if (!terms[t].rhs && i < x.size()) {
+				carry[terms[t].negative] += x[i];
+			}
+		}
+
+		for (int side = 0; side < 2; ++side) {
+			sums[side][i] = std::uint32_t(carry[side]);
+			carry[side] >>= 32;
+		}
+	}
+
+	// Accumulate each product into its sum, one row at a time.
+	for (std::size_t t = 0; t < terms.size(); ++t) {
+		if (!terms[t].rhs) {
+			continue;
+		}
+
+		const Limbs& a = operand_limbs[lhs_index[t]];
+		const Limbs& b = operand_limbs[rhs_index[t]];
+		const Limbs& longer = (a.size() >= b.size()) ? a : b;
+		const Limbs& shorter = (a.size() >= b.size()) ? b : a;
+		Limbs& sum = sums[terms[t].negative];
+
+		if (shorter.size() >= karatsuba_threshold) {
+			add_at(sum, mul(longer, shorter), 0);
+			continue;
+		}
+
+		for (std::size_t j = 0; j < shorter.size(); ++j) {
+			std::uint32_t row_carry = kernels()->addmul_1(&sum[j], longer.data(),
+				longer.size(), shorter[j]);
+			add_word_at(sum, row_carry, j + longer.size());
+		}
+	}
+
+	trim(sums[0]);
+	trim(sums[1]);
+
+	SignedLimbs result;
+	if (compare(sums[0], sums[1]) >= 0) {
+		result.mag = sub(sums[0], sums[1]);
+		result.neg = false;
+	}
+	else {
+		result.mag = sub(sums[1], sums[0]);
+		result.neg = true;
+	}
+
+	return from_signed_limbs(result);
+}
@@ -11,10 +11,9 @@
 // An Integer only supports non-negative numbers, and the operators
 // +, *, -, /, %, and their corresponding assignment operators (+=, etc.).
 //
-// To represent positive and negative integers, we have the derived class
-// SignedInteger. SignedIntegers have all of the same functionalities as
-// Integers, but they addtionally perform arithmetic on negative as well as
-// positive numbers.
+// To represent positive and negative integers, we have the class
+// SignedInteger. SignedIntegers perform the same arithmetic as Integers, on
+// negative as well as positive numbers.
 //
 // Known bugs:
 ////////////////////////////////////////////////////////////////////////////////
@@ -24,8 +23,130 @@
 
 #include <string>
 #include <vector>
+#include <deque>
+#include <type_traits>
 #include <iostream>
+#include <cstdint>
+#include <atomic>
+#include <stdexcept>
 
+// When the library (and every file that includes this header) is compiled
+// with INTEGER_USE_PMR defined, the storage of an Integer comes from a
+// std::pmr memory resource (see set_integer_resource below). This needs
+// C++17, and cannot be combined with INTEGER_COPY_ON_WRITE. Like that option,
+// it changes the layout of Integer, so it must be set the same way for the
+// whole program.
+#ifdef INTEGER_USE_PMR
+#if defined(INTEGER_COPY_ON_WRITE)
+#error "INTEGER_USE_PMR and INTEGER_COPY_ON_WRITE cannot both be defined"
+#elif __cplusplus < 201703L
+#error "INTEGER_USE_PMR needs C++17"
+#endif
+#include <memory_resource>
+#endif
+
+// With C++14, constexpr functions may contain loops, which the FixedInteger
+// templates below need.
+#if __cplusplus >= 201402L
+#define INTEGER_HAVE_FIXED
+#endif
+
+
+#ifdef INTEGER_USE_PMR
+
+// Return the memory resource from which Integers created by the calling
+// thread allocate their bits: the one set by set_integer_resource, or
+// std::pmr::get_default_resource() if none is set.
+std::pmr::memory_resource* integer_resource();
+
+// Make the calling thread's new Integers (including copies and temporaries)
+// allocate their bits from resource, for example an arena for a batch job:
+//   IntegerArena arena;
+//   IntegerResourceScope scope(&arena);
+//   ... // every Integer created here allocates from arena
+//   // arena frees everything at once when it is destroyed
+// An Integer keeps the resource it was created with, even when moved, so it
+// must not outlive the resource; copy it after the scope ends to keep it.
+// @param resource the resource to use, or nullptr for the default one
+// @return the previously selected resource
+std::pmr::memory_resource* set_integer_resource(std::pmr::memory_resource* resource);
+
+// A bump-pointer arena: allocation is a pointer increment, nothing is freed
+// until the arena is destroyed (or release() is called).
+typedef std::pmr::monotonic_buffer_resource IntegerArena;
+
+// A pool of size-class free lists, for long jobs whose Integers are freed and
+// reallocated over and over. Like IntegerArena, it is not thread-safe: use
+// one per thread. The library's own worker threads (as in mul_batch) never
+// allocate from the caller's resource; results are stored into the caller's
+// Integers on the calling thread.
+typedef std::pmr::unsynchronized_pool_resource IntegerPool;
+
+// Selects a resource with set_integer_resource for the lifetime of the
+// scope, then restores the previous one.
+class IntegerResourceScope {
+public:
+	explicit IntegerResourceScope(std::pmr::memory_resource* resource)
+		: previous_(set_integer_resource(resource)) {}
+	~IntegerResourceScope() { set_integer_resource(previous_); }
+
+	IntegerResourceScope(const IntegerResourceScope&) = delete;
+	IntegerResourceScope& operator=(const IntegerResourceScope&) = delete;
+
+private:
+	std::pmr::memory_resource* previous_;
+};
+
+#endif
+
+
+////////////////////////////////////////////////////////////////////////////////
+// @class SharedBits
+// @brief A vector of bools whose copies share storage until one is modified.
+//
+// Copying a SharedBits only increments an (atomic) reference count; the bits
+// are cloned by unshare() on a copy whose storage is shared. Copies may be
+// used and modified from different threads, like separate std::vector<bool>s.
+// Reading goes through the const operations, and modifying through the
+// vector that unshare() returns, so a member that changes many bits checks
+// the reference count once rather than once per bit.
+//
+// Integer stores its bits in a SharedBits when the library (and every file
+// that includes this header) is compiled with INTEGER_COPY_ON_WRITE defined,
+// which makes copying an Integer O(1). Otherwise it uses std::vector<bool>.
+////////////////////////////////////////////////////////////////////////////////
+
+class SharedBits {
+public:
+	SharedBits();
+	SharedBits(const SharedBits& other);
+	SharedBits(SharedBits&& other) noexcept;
+	SharedBits& operator=(const SharedBits& other);
+	SharedBits& operator=(SharedBits&& other) noexcept;
+	~SharedBits();
+
+	inline std::size_t size() const { return block_ ? block_->bits.size() : 0; }
+	inline bool operator[](std::size_t index) const { return block_->bits[index]; }
+	inline void swap(SharedBits& other) { std::swap(block_, other.block_); }
+
+	// Make sure no other SharedBits refers to the bits, cloning them if
+	// needed. The returned vector stays unshared until this SharedBits is
+	// copied or assigned.
+	// @return the bits, which may then be modified
+	std::vector<bool>& unshare();
+
+private:
+	struct Block {
+		std::atomic<long> refs;
+		std::vector<bool> bits;
+	};
+
+	// The shared storage (null only for a moved-from SharedBits).
+	Block* block_;
+
+	// Drop this reference to block_, deleting it if it was the last one.
+	void release();
+};
 
 ////////////////////////////////////////////////////////////////////////////////
 // @class Integer
@@ -35,6 +156,14 @@
 // multiplication. Currently it only allows for non-negative values. For example
 // if an Integer b is larger than a, then the expression a - b may have
 // arbitrary output. 
+//
+// Integer and SignedInteger are distinct value types with no virtual
+// functions (and so no vtable pointer), which lets every member be inlined
+// and lets them be stored by value in containers. SignedInteger builds on
+// Integer privately, so a SignedInteger never converts to an Integer& on its
+// own (where it would silently act as its absolute value); its magnitude()
+// has to be asked for. To keep values of both kinds in one collection, store
+// them by value (as SignedIntegers, or in an IntegerArray).
 ////////////////////////////////////////////////////////////////////////////////
 
 class Integer{
@@ -46,17 +175,29 @@ public:
 	// Constructor assigns a value val to bits_
 	Integer(unsigned int val);
 
+	// Copying duplicates bits_ (or, with INTEGER_COPY_ON_WRITE, shares them
+	// until one of the copies is modified). With INTEGER_USE_PMR, a copy
+	// allocates from the calling thread's Integer memory resource (see
+	// set_integer_resource).
+	// Moving takes over the storage of val instead, after which val may only
+	// be assigned to or destroyed. (Moving cannot throw, so a
+	// std::vector<Integer> moves its elements when it grows.)
+	Integer(const Integer& val);
+	Integer(Integer&& val) = default;
+	Integer& operator=(const Integer& val) = default;
+	Integer& operator=(Integer&& val) = default;
+
 	// Produce a string which contains the bits of
 	// the Integer (stored in bits_)
 	// @return an std::string in the form (...)_2 where "..." denotes the bits
 	// of the Integer
-	virtual std::string binary_string() const;
+	std::string binary_string() const;
 
 	// Produce a string which contains the digits of
 	// the Integer (stored in bits_)
 	// @return an std::string giving the decimal representation of the
 	// calling Integer.
-	virtual std::string decimal_string() const;
+	std::string decimal_string() const;
 
 	// Return the number of bits stored in bits_.
 	// @return an int containing the number of its in bits_.
@@ -96,11 +237,27 @@ public:
 	// Integer.
 	unsigned int get_int_value() const;
 
+	// Returns the value of the calling Integer modulo 2^64, i.e. its lowest 64
+	// bits, as a machine word.
+	// @return the lowest 64 bits of the calling Integer
+	std::uint64_t get_uint64_value() const;
+
+	// Assigns the machine word val to this instance of Integer, reusing the
+	// storage it already has.
+	// @param val the new value
+	void set_uint64_value(std::uint64_t val);
+
 	// Assigns the value stored in val to this instance of Integer.
 	// @param val a reference to the Integer which stores the desired new
 	// value
 	void set_value(const Integer& val);
 
+	// Assigns the value stored in the expiring Integer val to this instance by
+	// swapping storage with it, so no bits are copied. val is left holding
+	// the old value of this Integer.
+	// @param val the Integer which stores the desired new value
+	void set_value(Integer&& val);
+
 	// Computes the complement of this Integer by replacing each of its
 	// bits with the bits complement. That is, each "1" gets flipped to "0"
 	// and vice versa.
@@ -123,13 +280,13 @@ public:
 	Integer& operator-=(const Integer& rhs);
 
 	// Multiplies this Integer by the Integer on the right hand side.
-	// @param rhs is a pointer to the Integer to multiply
+	// @param rhs is a reference to the Integer to multiply
 	// @return a reference to this integer after multiplication
-	Integer& operator*=(Integer rhs);
+	Integer& operator*=(const Integer& rhs);
 
 	// Increment this integer by one (prefix)
 	// @return a reference to this integer (after incrementation).
-	virtual Integer& operator++();
+	Integer& operator++();
 
 	// Increment this integer by one (postfix)
 	// @return previous value (before incrementation).
@@ -153,10 +310,55 @@ public:
 	// @return a reference to the calling integer (with its new value)
 	Integer& operator%=(Integer rhs);
 
+	// Bitwise AND, OR and XOR of this Integer with rhs. The shorter operand is
+	// treated as if it were padded with zeros, so for example
+	//   Integer a(12); // (1100)_2
+	//   Integer b(10); // (1010)_2
+	//   a &= b; // a is now (1000)_2 = 8
+	// @param rhs the other operand
+	// @return a reference to the calling Integer (with its new value)
+	Integer& operator&=(const Integer& rhs);
+	Integer& operator|=(const Integer& rhs);
+	Integer& operator^=(const Integer& rhs);
+
+	// Return the number of 1 bits in this Integer.
+	int popcount() const;
+
+	// Return the number of 0 bits below the least significant 1 bit, i.e. the
+	// number of times 2 divides this Integer. If the Integer is 0, returns 0.
+	int count_trailing_zeros() const;
+
+	// Return the number of bits needed to write this Integer in binary, i.e.
+	// the index of the most significant 1 bit plus one. Unlike size(), the
+	// bit length of 0 is 0.
+	int bit_length() const;
+
+	// Tells if any of the bits with indices from lo up to (but not including)
+	// hi is 1. Indices past the most significant bit count as 0.
+	// @param lo the index of the first bit to check
+	// @param hi one past the index of the last bit to check
+	// @return true if and only if some bit in [lo, hi) is set
+	bool test_range(unsigned int lo, unsigned int hi) const;
+
 private:
 	// The bits that store the value of an Integer. Bits are stored
 	// from least to most significant.
+#if defined(INTEGER_COPY_ON_WRITE)
+	SharedBits bits_;
+#elif defined(INTEGER_USE_PMR)
+	std::pmr::vector<bool> bits_ = std::pmr::vector<bool>(integer_resource());
+#else
 	std::vector<bool> bits_;
+#endif
+
+	// Return bits_ ready to be modified. Members that change bits_ call this
+	// once and then work on the result, so copy-on-write storage is unshared
+	// once per call rather than once per bit.
+#if defined(INTEGER_COPY_ON_WRITE)
+	inline std::vector<bool>& mutable_bits() { return bits_.unshare(); }
+#else
+	inline decltype(bits_)& mutable_bits() { return bits_; }
+#endif
 
 	// Remove the trailing zeros from an Integer. For example,
 	// (00010110)_2 should be written as (10110)_2.
@@ -194,6 +396,16 @@ Integer operator-(Integer lhs, const Integer& rhs);
 // @return the product of lhs and rhs.
 Integer operator*(Integer lhs, const Integer& rhs);
 
+// The same operations when only rhs is a temporary (for example a + b * c).
+// Each of them is symmetric (operator- gives |lhs - rhs|), so the result is
+// computed in the storage of rhs instead of in a copy of lhs. A chain such
+// as a + b + c therefore allocates once (for the copy of a), plus once more
+// whenever a later operand is longer than the result so far; hw-03-alloc.cpp
+// checks this.
+Integer operator+(const Integer& lhs, Integer&& rhs);
+Integer operator-(const Integer& lhs, Integer&& rhs);
+Integer operator*(const Integer& lhs, Integer&& rhs);
+
 // Divide two integers and return the value of the result.
 // @param the dividend (Integer to be divided)
 // @param the divisor (Integer which is dividing the dividend)
@@ -206,6 +418,24 @@ Integer operator/(Integer lhs, const Integer& rhs);
 // @return the (Integer) modulus/remainder of the division
 Integer operator%(Integer lhs, const Integer& rhs);
 
+// Bitwise AND, OR and XOR of two Integers.
+// @param the left Integer
+// @param the right Integer (a reference)
+// @return the bitwise combination of lhs and rhs
+Integer operator&(Integer lhs, const Integer& rhs);
+Integer operator|(Integer lhs, const Integer& rhs);
+Integer operator^(Integer lhs, const Integer& rhs);
+Integer operator&(const Integer& lhs, Integer&& rhs);
+Integer operator|(const Integer& lhs, Integer&& rhs);
+Integer operator^(const Integer& lhs, Integer&& rhs);
+
+// Bitwise NOT. Since an Integer has no fixed width, only the bits up to its
+// most significant 1 bit are flipped (this is the same as complement()). For
+// example ~(10110)_2 = (1001)_2, and ~0 = 1.
+// @param val the Integer whose bits are flipped
+// @return the complement of val
+Integer operator~(Integer val);
+
 // Check if two integers have the same value.
 // @param the left Integer
 // @param the right Integer
@@ -228,24 +458,54 @@ void reverse(std::string& str);
 // Longer description
 ////////////////////////////////////////////////////////////////////////////////
 
-class SignedInteger : public Integer {
+class SignedInteger : private Integer {
 public:
 	SignedInteger();
 	SignedInteger(int val);
-	SignedInteger(Integer& val);
+	explicit SignedInteger(const Integer& val);
+	SignedInteger(const SignedInteger& val) = default;
+	SignedInteger(SignedInteger&& val) = default;
+	SignedInteger& operator=(const SignedInteger& val) = default;
+	SignedInteger& operator=(SignedInteger&& val) = default;
 
 	inline bool is_negative() const { return neg_; }
 	inline void negate() { neg_ = !neg_; }
 
-	virtual std::string binary_string() const;
-	virtual std::string decimal_string() const;
+	// Return the absolute value of this SignedInteger. A SignedInteger is not
+	// an Integer, so it cannot be passed to a function taking an Integer by
+	// mistake (and then lose its sign); the magnitude has to be asked for.
+	// @return the absolute value, as an Integer
+	inline const Integer& magnitude() const { return *this; }
+
+	using Integer::is_zero;
+
+	// Tells if the value of this SignedInteger fits in a machine word, i.e. if
+	// its absolute value is below 2^63. The arithmetic operators check this
+	// first, and when both operands fit they compute with native (overflow-
+	// checked) instructions, falling back on the bit-by-bit algorithms only
+	// when the result does not fit.
+	// @return true if get_int64_value returns the exact value
+	inline bool fits_int64() const { return size() < 64; }
+
+	// Returns the value of this SignedInteger as a machine word. The result is
+	// only meaningful if fits_int64() is true.
+	// @return the value of the calling SignedInteger
+	std::int64_t get_int64_value() const;
+
+	// Assigns the machine word val to this SignedInteger, reusing the storage
+	// it already has.
+	// @param val the new value
+	void set_int64_value(std::int64_t val);
+
+	std::string binary_string() const;
+	std::string decimal_string() const;
 
 	SignedInteger& operator+=(const SignedInteger& rhs);
 	SignedInteger& operator-=(const SignedInteger& rhs);
 	SignedInteger& operator*=(const SignedInteger& rhs);
 	SignedInteger& operator/=(const SignedInteger& rhs);
 	SignedInteger& operator%=(const SignedInteger& rhs);
-	virtual SignedInteger& operator++();
+	SignedInteger& operator++();
 	SignedInteger operator++(int unused);
 
 private:
@@ -262,6 +522,17 @@ SignedInteger operator*(SignedInteger lhs, const SignedInteger& rhs);
 SignedInteger operator/(SignedInteger lhs, const SignedInteger& rhs);
 SignedInteger operator%(SignedInteger lhs, const SignedInteger& rhs);
 
+// As for Integer, reuse the storage of rhs when only rhs is a temporary.
+SignedInteger operator+(const SignedInteger& lhs, SignedInteger&& rhs);
+SignedInteger operator-(const SignedInteger& lhs, SignedInteger&& rhs);
+SignedInteger operator*(const SignedInteger& lhs, SignedInteger&& rhs);
+
+// Checks if lhs and rhs store the same value, sign included
+// @param lhs the left SignedInteger to be compared
+// @param rhs the right SignedInteger to be compared
+// @return true if and only if lhs and rhs are equal
+bool operator==(const SignedInteger& lhs, const SignedInteger& rhs);
+
 unsigned int absolute_value(int n);
 
 // the output operator for Integer
@@ -281,5 +552,1347 @@ std::ostream& operator << (std::ostream& os, const SignedInteger& val);
 std::istream& operator >> (std::istream& is, SignedInteger& val);
 
 
+// Compute base raised to the power exp, modulo mod, without ever forming the
+// (huge) value base^exp. For odd moduli the multiplications are done in
+// Montgomery form, so no division is needed inside the loop; even moduli fall
+// back on reducing each product with long division. In both cases the
+// exponent is scanned with a sliding window.
+//   Integer a(4);
+//   Integer b(13);
+//   Integer m(497);
+//   powmod(a, b, m); // 4^13 mod 497 = 445
+// @param base the Integer to be raised to a power
+// @param exp the (non-negative) exponent
+// @param mod the modulus, which must not be 0
+// @return the Integer (base^exp) mod mod, which is between 0 and mod - 1
+Integer powmod(const Integer& base, const Integer& exp, const Integer& mod);
+
+
+// Compute the greatest common divisor of a and b. Small values use the binary
+// GCD algorithm on machine words, while large values use Lehmer's algorithm,
+// which performs most steps of Euclid's algorithm on single words. Note that
+// gcd(a, 0) = a. For SignedIntegers the gcd of the absolute values is computed.
+// @param a the first Integer
+// @param b the second Integer
+// @return the largest Integer which divides both a and b
+Integer gcd(const Integer& a, const Integer& b);
+
+// Compute the least common multiple of a and b (0 if either one is 0).
+// @param a the first Integer
+// @param b the second Integer
+// @return the smallest positive Integer which is a multiple of both a and b
+Integer lcm(const Integer& a, const Integer& b);
+
+// Extended Euclidean algorithm. Computes g = gcd(a, b) together with
+// coefficients x and y such that a * x + b * y = g. For example
+//   SignedInteger x, y;
+//   ext_gcd(Integer(240), Integer(46), x, y); // returns 2, x = 14, y = -73
+// @param a the first Integer
+// @param b the second Integer
+// @param x a reference which receives the coefficient of a
+// @param y a reference which receives the coefficient of b
+// @return the gcd of a and b
+Integer ext_gcd(const Integer& a, const Integer& b, SignedInteger& x,
+	SignedInteger& y);
+
+// Extended Euclidean algorithm for SignedIntegers. The returned gcd is never
+// negative, and a * x + b * y = gcd(a, b) holds with the signs of a and b.
+SignedInteger ext_gcd(const SignedInteger& a, const SignedInteger& b,
+	SignedInteger& x, SignedInteger& y);
+
+// Compute the inverse of a modulo m, i.e. the Integer x between 0 and m - 1 with
+// a * x = 1 (mod m). If no inverse exists (gcd(a, m) != 1), an error is printed
+// and 0 is returned.
+// @param a the Integer to be inverted
+// @param m the modulus, which must not be 0
+// @return the inverse of a modulo m
+Integer mod_inverse(const Integer& a, const Integer& m);
+
+// Compute the inverse of a (which may be negative) modulo m.
+Integer mod_inverse(const SignedInteger& a, const Integer& m);
+
+
+// Compute the integer square root of val, i.e. the largest Integer r with
+// r * r <= val. The root is found with Newton's iteration.
+//   isqrt(Integer(99)); // 9
+// @param val the Integer whose root is taken
+// @return the square root of val, rounded down
+Integer isqrt(const Integer& val);
+
+// Compute the integer n-th root of val, i.e. the largest Integer r with
+// r^n <= val. If n is 0, an error is printed and val is returned.
+//   iroot(Integer(1000), 3); // 10
+//   iroot(Integer(1001), 3); // 10
+// @param val the Integer whose root is taken
+// @param n the degree of the root
+// @return the n-th root of val, rounded down
+Integer iroot(const Integer& val, unsigned int n);
+
+// Check if val is the square of an Integer. Most non-squares are ruled out by
+// checking residues modulo a few small numbers, before any root is computed.
+// @param val the Integer to be checked
+// @return true if and only if val = r * r for some Integer r
+bool is_perfect_square(const Integer& val);
+
+// Check if val is a perfect power, i.e. val = r^k for some Integers r and
+// k >= 2. Note that 0 and 1 are perfect powers.
+// @param val the Integer to be checked
+// @return true if and only if val is a perfect power
+bool is_perfect_power(const Integer& val);
+
+
+// Check if val is (very probably) prime. Trial division by the primes below
+// 4096 comes first, followed by the Baillie-PSW test: a strong Miller-Rabin
+// test to base 2 and a strong Lucas test. No composite is known to pass
+// Baillie-PSW, and none exists below 2^64. For extra assurance, rounds more
+// Miller-Rabin tests are run with the bases 3, 5, 7, ....
+// @param val the Integer to be tested
+// @param rounds the number of additional Miller-Rabin rounds
+// @return false if val is certainly composite (or less than 2), and true if
+// val is prime or a (very unlikely) pseudoprime
+bool is_probable_prime(const Integer& val, unsigned int rounds);
+
+// Find the smallest (probable) prime larger than val. Candidates are sieved by
+// the small primes in windows of 4096 odd values, so the expensive tests only
+// run on values with no small factors.
+//   next_prime(Integer(100)); // 101
+// @param val the Integer to start the search from
+// @return the smallest Integer greater than val passing is_probable_prime
+Integer next_prime(const Integer& val);
+
+
+// Factor val into primes. Small factors are removed by trial division with a
+// 2-3-5 wheel; the remaining cofactor is split with Pollard-Brent rho and then,
+// if rho fails, with stage 1 of the elliptic curve method. This is practical for
+// values of up to about 200 bits.
+//   factor(Integer(360)); // {2, 2, 2, 3, 3, 5}
+// @param val the Integer to be factored
+// @return the prime factors of val in increasing order, repeated according
+// to multiplicity (empty if val is 0 or 1)
+std::vector<Integer> factor(const Integer& val);
+
+// Factor each of values, spreading the values over several threads.
+// @param values the Integers to be factored
+// @param num_threads the maximum number of threads to use, or 0 for one per
+// hardware thread
+// @return the factorizations, in the same order as values
+std::vector<std::vector<Integer> > factor_all(const std::vector<Integer>& values,
+	unsigned int num_threads);
+
+// Add up values, spreading the work over several threads.
+// @param values the SignedIntegers to be added
+// @param num_threads the maximum number of threads to use, or 0 for the
+// limit set by set_max_threads
+// @return the sum of values (0 if values is empty)
+SignedInteger parallel_sum(const std::vector<SignedInteger>& values,
+	unsigned int num_threads);
+
+// Multiply values together, spreading the work over several threads. The
+// values are multiplied in a balanced tree, so the large products near the
+// root are between operands of similar size.
+// @param values the SignedIntegers to be multiplied
+// @param num_threads the maximum number of threads to use, or 0 for the
+// limit set by set_max_threads
+// @return the product of values (1 if values is empty)
+SignedInteger parallel_product(const std::vector<SignedInteger>& values,
+	unsigned int num_threads);
+
+// Compute both the sum and the product of values in a single pass over
+// them (each value is read once), spreading the work over several threads.
+// @param values the SignedIntegers to be added and multiplied
+// @param sum set to the sum of values
+// @param product set to the product of values
+// @param num_threads the maximum number of threads to use, or 0 for the
+// limit set by set_max_threads
+void parallel_sum_product(const std::vector<SignedInteger>& values, SignedInteger& sum,
+	SignedInteger& product, unsigned int num_threads);
+
+// Element-wise arithmetic over arrays of Integers: out[i] = a[i] + b[i],
+// out[i] = a[i] - b[i] (as an absolute value, like operator-=) or
+// out[i] = a[i] * b[i] for 0 <= i < count. The results are written into the
+// existing storage of out[i], and out may be the same array as a or b.
+// Batches of values below 64 bits are computed on machine words, and large
+// batches are spread over several threads.
+//   std::vector<Integer> a = ..., b = ..., c(a.size());
+//   add_batch(a.data(), b.data(), c.data(), a.size(), 0);
+// @param a the left operands
+// @param b the right operands
+// @param out the array receiving the results
+// @param count the number of elements in a, b and out
+// @param num_threads the maximum number of threads to use, or 0 for the
+// limit set by set_max_threads
+void add_batch(const Integer* a, const Integer* b, Integer* out, std::size_t count,
+	unsigned int num_threads);
+void sub_batch(const Integer* a, const Integer* b, Integer* out, std::size_t count,
+	unsigned int num_threads);
+void mul_batch(const Integer* a, const Integer* b, Integer* out, std::size_t count,
+	unsigned int num_threads);
+
+
+// Select the set of low-level kernels used for the word-by-word loops of the
+// number-theoretic functions above (and of ModContext and ModInteger). On
+// first use the fastest set the CPU supports is chosen automatically: "bmi2"
+// (mulx and 64-bit add-with-carry), "avx2" (vectorized carry-lookahead
+// addition) or "generic" (portable C++). Forcing a set is meant for
+// benchmarking and testing. It is safe while other threads use the library
+// (all sets compute the same results), though an operation already running
+// may finish with the previous set.
+// @param name the name of the kernel set
+// @return true if the set was selected, and false (leaving the selection
+// unchanged) if the name is unknown or the CPU lacks the instructions
+bool force_kernels(const std::string& name);
+
+// Return the name of the kernel set currently in use.
+std::string active_kernels();
+
+// Limit the number of threads used by multiplication and decimal conversion
+// of very large values (and by the other multi-threaded functions of this
+// library that are not given an explicit thread count).
+// @param num_threads the maximum number of threads; 0 (the default) means
+// one per hardware thread
+void set_max_threads(unsigned int num_threads);
+
+// Return the number of threads multiplication and decimal conversion of very
+// large values may use.
+// @return the value set by set_max_threads, or the number of hardware
+// threads if that value is 0
+unsigned int max_threads();
+
+// Set the size below which multiplication and decimal conversion stay on the
+// calling thread. Starting threads costs more than working on small values,
+// so only products where both factors have at least num_bits bits (and
+// decimal_string of values with at least num_bits bits) are split across
+// threads. The default is 65536 bits.
+// @param num_bits the minimum size (in bits) of the operands
+void set_parallel_cutoff(unsigned int num_bits);
+
+
+////////////////////////////////////////////////////////////////////////////////
+// @class ModContext
+// @brief Reduces Integers modulo one fixed modulus using Barrett reduction.
+//
+// Computing val % m with operator%= performs a full long division every time.
+// A ModContext instead precomputes a reciprocal mu = floor(2^(64k) / m) (where
+// k is the number of 32-bit words in m) once, after which any value below m^2
+// can be reduced with two multiplications and at most two subtractions.
+// Example usage:
+//   ModContext ctx(Integer(97));
+//   ctx.reduce(Integer(1000)); // 1000 mod 97 = 30
+//   ctx.mul(Integer(50), Integer(60)); // 3000 mod 97 = 90
+//
+// A ModContext is never modified after it is constructed, so a single
+// instance may be shared by several threads.
+////////////////////////////////////////////////////////////////////////////////
+
+class ModContext {
+public:
+	// Precompute the Barrett reciprocal of modulus, which must not be 0.
+	// @param modulus the Integer by which values will be reduced
+	ModContext(const Integer& modulus);
+
+	// Return the modulus this context reduces by.
+	inline const Integer& modulus() const { return modulus_; }
+
+	// Compute val mod modulus(). Values below modulus()^2 take the fast Barrett
+	// path; larger values fall back on long division.
+	// @param val the Integer to be reduced
+	// @return an Integer between 0 and modulus() - 1
+	Integer reduce(const Integer& val) const;
+
+	// Compute (lhs * rhs) mod modulus(). If lhs and rhs are already reduced,
+	// their product is below modulus()^2 and is reduced with the fast path.
+	// @param lhs the left Integer to be multiplied
+	// @param rhs the right Integer to be multiplied
+	// @return the product of lhs and rhs, reduced by modulus()
+	Integer mul(const Integer& lhs, const Integer& rhs) const;
+
+private:
+	// The modulus, both as an Integer and as 32-bit words (least significant
+	// word first).
+	Integer modulus_;
+	std::vector<std::uint32_t> m_;
+
+	// The Barrett reciprocal floor(2^(64k) / m), where k = m_.size().
+	std::vector<std::uint32_t> mu_;
+
+	// For odd moduli, ModIntegers are stored in Montgomery form x * R mod m,
+	// where R = 2^(32k). m_inv_ is -m^(-1) mod 2^32 and r2_ is R^2 mod m.
+	bool montgomery_;
+	std::uint32_t m_inv_;
+	std::vector<std::uint32_t> r2_;
+
+	friend class ModInteger;
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// @class ModInteger
+// @brief An element of Z/nZ, i.e. an Integer that always stays reduced.
+//
+// A ModInteger refers to a ModContext which holds its modulus n; the context
+// must outlive every ModInteger that uses it, and both operands of a binary
+// operator must share the same context. The operators +, -, * (and their
+// assignment forms) always produce values between 0 and n - 1. When n is odd
+// the value is kept internally in Montgomery form, so a chain of
+// multiplications never needs a division; for even n each product is reduced
+// with the context's Barrett reciprocal. Example usage:
+//   ModContext ctx(Integer(101));
+//   ModInteger a(Integer(50), ctx);
+//   ModInteger b(Integer(60), ctx);
+//   (a * b).value();        // 3000 mod 101 = 71
+//   (a - b).value();        // -10 mod 101 = 91
+//   a.inverse().value();    // 50 * 99 = 1 (mod 101), so this is 99
+////////////////////////////////////////////////////////////////////////////////
+
+class ModInteger {
+public:
+	// Construct the value 0 modulo ctx.modulus()
+	ModInteger(const ModContext& ctx);
+
+	// Construct the value val mod ctx.modulus()
+	ModInteger(const Integer& val, const ModContext& ctx);
+
+	// Return the context (and hence the modulus) of this ModInteger.
+	inline const ModContext& context() const { return *ctx_; }
+
+	// Return the value of this ModInteger as an ordinary Integer.
+	// @return an Integer between 0 and context().modulus() - 1
+	Integer value() const;
+
+	// Add rhs to this ModInteger, modulo context().modulus()
+	ModInteger& operator+=(const ModInteger& rhs);
+
+	// Subtract rhs from this ModInteger, modulo context().modulus(). Unlike
+	// Integer::operator-=, the result wraps around instead of taking the
+	// absolute value.
+	ModInteger& operator-=(const ModInteger& rhs);
+
+	// Multiply this ModInteger by rhs, modulo context().modulus()
+	ModInteger& operator*=(const ModInteger& rhs);
+
+	// Compute the multiplicative inverse of this ModInteger. If none exists
+	// (the value and the modulus share a factor) an error is printed and the
+	// result is 0.
+	// @return the ModInteger x with x * (*this) = 1 (mod context().modulus())
+	ModInteger inverse() const;
+
+private:
+	// The context which holds the modulus
+	const ModContext* ctx_;
+
+	// The reduced value as 32-bit words (least significant word first), in
+	// Montgomery form if the modulus is odd.
+	std::vector<std::uint32_t> val_;
+
+	friend bool operator==(const ModInteger& lhs, const ModInteger& rhs);
+};
+
+ModInteger operator+(ModInteger lhs, const ModInteger& rhs);
+ModInteger operator-(ModInteger lhs, const ModInteger& rhs);
+ModInteger operator*(ModInteger lhs, const ModInteger& rhs);
+
+// Check if two ModIntegers (with the same context) have the same value.
+bool operator==(const ModInteger& lhs, const ModInteger& rhs);
+
+
+////////////////////////////////////////////////////////////////////////////////
+// @class IntegerView
+// @brief A read-only reference to a signed value stored as 32-bit words.
+//
+// An IntegerView does not own its words: it is a pointer to length words
+// (least significant word first, with no leading zero words, so 0 has length
+// 0) and a sign. The words must stay valid for as long as the view is used.
+// Views are cheap to copy and are what IntegerArray hands out for its
+// elements. They can just as well point into a memory-mapped file or a
+// network buffer, and the comparison and arithmetic functions declared below
+// accept them directly, without building an Integer first:
+//   std::uint32_t words[2] = { 0, 1 }; // 2^32
+//   IntegerView a(words, 2, false);
+//   IntegerView b(words + 1, 1, true); // -1
+//   (a * b).decimal_string(); // "-4294967296"
+//   a > b; // true
+////////////////////////////////////////////////////////////////////////////////
+
+class IntegerView {
+public:
+	// Construct a view of the value 0.
+	IntegerView();
+
+	// Construct a view of the given words.
+	// @param limbs the words of the magnitude, least significant first
+	// @param length the number of words (the top word must not be 0)
+	// @param negative true if the value is negative (ignored if it is 0)
+	IntegerView(const std::uint32_t* limbs, std::size_t length, bool negative);
+
+	inline const std::uint32_t* limbs() const { return limbs_; }
+	inline std::size_t length() const { return length_; }
+	inline bool is_negative() const { return neg_; }
+	inline bool is_zero() const { return length_ == 0; }
+
+	// Copy the magnitude of the viewed value into an Integer.
+	// @return the absolute value of the viewed value
+	Integer to_integer() const;
+
+	// Copy the viewed value (with its sign) into a SignedInteger.
+	// @return the viewed value
+	SignedInteger to_signed_integer() const;
+
+private:
+	const std::uint32_t* limbs_;
+	std::size_t length_;
+	bool neg_;
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// @class IntegerArray
+// @brief A sequence of signed values packed into one contiguous buffer.
+//
+// A std::vector<SignedInteger> keeps a separate heap-allocated bit vector
+// (plus a sign) for every element. An IntegerArray stores
+// the 32-bit words of all its elements back to back in a single vector, with a
+// side table of where each element starts and whether it is negative, so
+// scanning the elements walks through memory in order. Elements are read
+// through IntegerViews, which stay valid until the next push_back or clear.
+// Example usage:
+//   IntegerArray values;
+//   values.push_back(SignedInteger(-5));
+//   values.push_back(Integer(7));
+//   for (IntegerArray::const_iterator it = values.begin(); it != values.end(); ++it) {
+//     std::cout << (*it).to_signed_integer() << std::endl;
+//   }
+//   parallel_sum(values, 0); // 2
+////////////////////////////////////////////////////////////////////////////////
+
+class IntegerArray {
+public:
+	class const_iterator {
+	public:
+		const_iterator(const IntegerArray* array, std::size_t index)
+			: array_(array), index_(index) {}
+
+		inline IntegerView operator*() const { return (*array_)[index_]; }
+		inline const_iterator& operator++() { ++index_; return *this; }
+		inline const_iterator operator++(int) { const_iterator old = *this; ++index_; return old; }
+		inline bool operator==(const const_iterator& rhs) const { return index_ == rhs.index_; }
+		inline bool operator!=(const const_iterator& rhs) const { return index_ != rhs.index_; }
+
+	private:
+		const IntegerArray* array_;
+		std::size_t index_;
+	};
+
+	// Construct an empty array.
+	IntegerArray();
+
+	// Return the number of elements.
+	inline std::size_t size() const { return negative_.size(); }
+	inline bool empty() const { return negative_.empty(); }
+
+	// Reserve room for count elements with num_limbs 32-bit words in total.
+	void reserve(std::size_t count, std::size_t num_limbs);
+
+	// Remove all elements (keeping the allocated storage).
+	void clear();
+
+	// Append a value to the end of the array.
+	// @param val the value to be appended (a SignedInteger keeps its sign)
+	void push_back(const Integer& val);
+	void push_back(const SignedInteger& val);
+	void push_back(const IntegerView& val);
+
+	// Return a view of the element at index, which must be less than size().
+	IntegerView operator[](std::size_t index) const;
+
+	inline const_iterator begin() const { return const_iterator(this, 0); }
+	inline const_iterator end() const { return const_iterator(this, size()); }
+
+private:
+	// The words of all elements, back to back. Element i occupies
+	// limbs_[offsets_[i], offsets_[i + 1]).
+	std::vector<std::uint32_t> limbs_;
+	std::vector<std::size_t> offsets_;
+
+	// The sign of each element.
+	std::vector<bool> negative_;
+};
+
+// Compute the sum, the product, or both, of the elements of an IntegerArray,
+// as for the std::vector<SignedInteger> versions above.
+SignedInteger parallel_sum(const IntegerArray& values, unsigned int num_threads);
+SignedInteger parallel_product(const IntegerArray& values, unsigned int num_threads);
+void parallel_sum_product(const IntegerArray& values, SignedInteger& sum,
+	SignedInteger& product, unsigned int num_threads);
+
+// Compare the values viewed by lhs and rhs (with their signs).
+// @return -1, 0 or 1 if lhs is less than, equal to or greater than rhs
+int compare(const IntegerView& lhs, const IntegerView& rhs);
+
+bool operator==(const IntegerView& lhs, const IntegerView& rhs);
+bool operator!=(const IntegerView& lhs, const IntegerView& rhs);
+bool operator<(const IntegerView& lhs, const IntegerView& rhs);
+bool operator<=(const IntegerView& lhs, const IntegerView& rhs);
+bool operator>(const IntegerView& lhs, const IntegerView& rhs);
+bool operator>=(const IntegerView& lhs, const IntegerView& rhs);
+
+// Arithmetic on viewed values, which reads their words in place instead of
+// first copying them into Integers. As for SignedInteger, division truncates
+// toward zero and the remainder has the sign of lhs; dividing by 0 prints an
+// error and returns lhs.
+SignedInteger operator+(const IntegerView& lhs, const IntegerView& rhs);
+SignedInteger operator-(const IntegerView& lhs, const IntegerView& rhs);
+SignedInteger operator*(const IntegerView& lhs, const IntegerView& rhs);
+SignedInteger operator/(const IntegerView& lhs, const IntegerView& rhs);
+SignedInteger operator%(const IntegerView& lhs, const IntegerView& rhs);
+
+// The greatest common divisor of |a| and |b|, as for the Integer version.
+Integer gcd(const IntegerView& a, const IntegerView& b);
+
+// Compute base^exp mod m, as for the Integer version. A negative base is
+// allowed (its result is still between 0 and |mod| - 1); the signs of exp and
+// mod are ignored.
+Integer powmod(const IntegerView& base, const IntegerView& exp, const IntegerView& mod);
+
+
+////////////////////////////////////////////////////////////////////////////////
+// @class TwosComplementInteger
+// @brief A signed value stored in two's complement, for sign-independent adds.
+//
+// A SignedInteger keeps a sign and a magnitude, so adding values of opposite
+// signs means comparing the magnitudes, subtracting the smaller one from the
+// larger and fixing up the sign. A TwosComplementInteger instead stores its
+// value as 32-bit words in two's complement (least significant word first,
+// with the top bit of the last word as the sign, and no redundant sign
+// words, so 0 has no words at all). Then += and -= are one carry pass over
+// the words whatever the signs, the shorter operand simply being extended
+// with its sign word. The sign and magnitude are only worked out when the
+// value is converted (to_signed_integer) or printed. Example usage:
+//   TwosComplementInteger total;
+//   for (std::size_t i = 0; i < values.size(); ++i) {
+//     total += values[i]; // values is a std::vector<SignedInteger>
+//   }
+//   std::cout << total << std::endl;
+////////////////////////////////////////////////////////////////////////////////
+
+class TwosComplementInteger {
+public:
+	// Default constructor--default value is 0
+	TwosComplementInteger();
+
+	// Construct the value val
+	TwosComplementInteger(std::int64_t val);
+	TwosComplementInteger(const Integer& val);
+
+	// Construct the value val (keeping its sign)
+	TwosComplementInteger(const SignedInteger& val);
+
+	// Tells if the value is less than 0, i.e. if the top bit is set.
+	inline bool is_negative() const { return !limbs_.empty() && (limbs_.back() >> 31) != 0; }
+	inline bool is_zero() const { return limbs_.empty(); }
+
+	// Return the number of 32-bit words (including the sign).
+	inline std::size_t length() const { return limbs_.size(); }
+
+	// Convert to sign-magnitude form.
+	// @return a SignedInteger with the same value
+	SignedInteger to_signed_integer() const;
+
+	// Produce the same strings as for the equal SignedInteger (both convert
+	// through to_signed_integer).
+	std::string binary_string() const;
+	std::string decimal_string() const;
+
+	// Replace the value with its negative.
+	void negate();
+
+	TwosComplementInteger& operator+=(const TwosComplementInteger& rhs);
+	TwosComplementInteger& operator-=(const TwosComplementInteger& rhs);
+
+	// Multiplication, division and remainder work on the magnitudes, as for
+	// SignedInteger: division truncates toward zero, and the remainder has
+	// the sign of this value. Dividing by 0 prints an error and leaves the
+	// value unchanged.
+	TwosComplementInteger& operator*=(const TwosComplementInteger& rhs);
+	TwosComplementInteger& operator/=(const TwosComplementInteger& rhs);
+	TwosComplementInteger& operator%=(const TwosComplementInteger& rhs);
+
+	TwosComplementInteger& operator++();
+	TwosComplementInteger& operator--();
+
+private:
+	// The words of the value in two's complement, least significant first.
+	std::vector<std::uint32_t> limbs_;
+
+	// Add rhs to (or subtract it from) this value in one carry pass.
+	void add(const TwosComplementInteger& rhs, bool subtract);
+
+	// Remove redundant sign words from the top.
+	void normalize();
+
+	// Replace the value with its quotient by rhs (or the remainder if
+	// remainder is true). Both operators share this one check for 0.
+	void divide(const TwosComplementInteger& rhs, bool remainder);
+
+	friend int compare(const TwosComplementInteger& lhs, const TwosComplementInteger& rhs);
+};
+
+TwosComplementInteger operator+(TwosComplementInteger lhs, const TwosComplementInteger& rhs);
+TwosComplementInteger operator-(TwosComplementInteger lhs, const TwosComplementInteger& rhs);
+TwosComplementInteger operator*(TwosComplementInteger lhs, const TwosComplementInteger& rhs);
+TwosComplementInteger operator/(TwosComplementInteger lhs, const TwosComplementInteger& rhs);
+TwosComplementInteger operator%(TwosComplementInteger lhs, const TwosComplementInteger& rhs);
+TwosComplementInteger operator-(TwosComplementInteger val);
+
+// Compare two TwosComplementIntegers.
+// @return -1, 0 or 1 if lhs is less than, equal to or greater than rhs
+int compare(const TwosComplementInteger& lhs, const TwosComplementInteger& rhs);
+
+bool operator==(const TwosComplementInteger& lhs, const TwosComplementInteger& rhs);
+bool operator!=(const TwosComplementInteger& lhs, const TwosComplementInteger& rhs);
+bool operator<(const TwosComplementInteger& lhs, const TwosComplementInteger& rhs);
+bool operator<=(const TwosComplementInteger& lhs, const TwosComplementInteger& rhs);
+bool operator>(const TwosComplementInteger& lhs, const TwosComplementInteger& rhs);
+bool operator>=(const TwosComplementInteger& lhs, const TwosComplementInteger& rhs);
+
+// the output operator for TwosComplementInteger
+// write the value of val (in decimal, with its sign) to stream
+std::ostream& operator << (std::ostream& os, const TwosComplementInteger& val);
+
+
+#ifdef INTEGER_HAVE_FIXED
+
+////////////////////////////////////////////////////////////////////////////////
+// @class FixedInteger
+// @brief A non-negative Integer of a fixed width, stored inline.
+//
+// A FixedInteger<Bits> holds a value between 0 and 2^Bits - 1 in an array of
+// Bits / 32 words inside the object itself, so creating, copying and doing
+// arithmetic on it never allocates memory. The width is a compile-time
+// constant, so the compiler can unroll the loops over the words, and all the
+// arithmetic is constexpr:
+//   constexpr FixedInteger<256> a(1000000007);
+//   constexpr FixedInteger<256> b = a * a % FixedInteger<256>(998244353);
+// Like the unsigned machine types (and unlike Integer), + - * wrap around
+// modulo 2^Bits. Division by 0 throws std::domain_error (and so is a compile
+// error in a constant expression). Converting from an
+// Integer keeps the lowest Bits bits, and to_integer converts back.
+////////////////////////////////////////////////////////////////////////////////
+
+template <unsigned int Bits>
+class FixedInteger {
+	static_assert(Bits > 0 && Bits % 32 == 0, "FixedInteger needs a positive multiple of 32 bits");
+
+public:
+	// The number of 32-bit words in the value.
+	static constexpr std::size_t num_limbs = Bits / 32;
+
+	// Default constructor--default value is 0
+	constexpr FixedInteger() : limbs_() {}
+
+	// Construct the value val (mod 2^Bits)
+	constexpr FixedInteger(std::uint64_t val) : limbs_() {
+		limbs_[0] = std::uint32_t(val);
+		if (num_limbs > 1) {
+			limbs_[num_limbs > 1 ? 1 : 0] = std::uint32_t(val >> 32);
+		}
+	}
+
+	// Construct the value val mod 2^Bits, i.e. the lowest Bits bits of val
+	explicit FixedInteger(const Integer& val) : limbs_() {
+		unsigned int num_bits = (unsigned(val.size()) < Bits) ? unsigned(val.size()) : Bits;
+		for (unsigned int i = 0; i < num_bits; ++i) {
+			if (val.get_bit(i)) {
+				limbs_[i / 32] |= std::uint32_t(1) << (i % 32);
+			}
+		}
+	}
+
+	// Convert this value to an Integer.
+	Integer to_integer() const {
+		return IntegerView(limbs_, length(), false).to_integer();
+	}
+
+	// Return word i of the value (least significant first), or all of them.
+	constexpr std::uint32_t limb(std::size_t i) const { return limbs_[i]; }
+	constexpr const std::uint32_t* limbs() const { return limbs_; }
+
+	// Set word i of the value to w.
+	constexpr void set_limb(std::size_t i, std::uint32_t w) { limbs_[i] = w; }
+
+	// Return the number of words up to and including the top non-zero one.
+	constexpr std::size_t length() const {
+		std::size_t n = num_limbs;
+		while (n > 0 && limbs_[n - 1] == 0) {
+			--n;
+		}
+		return n;
+	}
+
+	constexpr bool is_zero() const { return length() == 0; }
+
+	// Return bit index of the value (false past the top).
+	constexpr bool get_bit(unsigned int index) const {
+		return index < Bits && ((limbs_[index / 32] >> (index % 32)) & 1) != 0;
+	}
+
+	std::string binary_string() const { return to_integer().binary_string(); }
+	std::string decimal_string() const { return to_integer().decimal_string(); }
+
+	constexpr FixedInteger& operator+=(const FixedInteger& rhs) {
+		std::uint64_t carry = 0;
+		for (std::size_t i = 0; i < num_limbs; ++i) {
+			carry += std::uint64_t(limbs_[i]) + rhs.limbs_[i];
+			limbs_[i] = std::uint32_t(carry);
+			carry >>= 32;
+		}
+		return *this;
+	}
+
+	constexpr FixedInteger& operator-=(const FixedInteger& rhs) {
+		std::uint32_t borrow = 0;
+		for (std::size_t i = 0; i < num_limbs; ++i) {
+			std::uint64_t diff = std::uint64_t(limbs_[i]) - rhs.limbs_[i] - borrow;
+			limbs_[i] = std::uint32_t(diff);
+			borrow = std::uint32_t(diff >> 63);
+		}
+		return *this;
+	}
+
+	constexpr FixedInteger& operator*=(const FixedInteger& rhs) {
+
+		// Schoolbook multiplication, dropping the words past the top. (rhs
+		// may be this value, so the product is built separately.)
+		FixedInteger prod;
+		for (std::size_t i = 0; i < num_limbs; ++i) {
+			std::uint64_t carry = 0;
+			for (std::size_t j = 0; i + j < num_limbs; ++j) {
+				carry += std::uint64_t(limbs_[i]) * rhs.limbs_[j] + prod.limbs_[i + j];
+				prod.limbs_[i + j] = std::uint32_t(carry);
+				carry >>= 32;
+			}
+		}
+
+		*this = prod;
+		return *this;
+	}
+
+	constexpr FixedInteger& operator/=(const FixedInteger& rhs) {
+		FixedInteger rem;
+		divmod(*this, rhs, *this, rem);
+		return *this;
+	}
+
+	constexpr FixedInteger& operator%=(const FixedInteger& rhs) {
+		FixedInteger quot;
+		divmod(*this, rhs, quot, *this);
+		return *this;
+	}
+
+	constexpr FixedInteger& operator++() {
+		for (std::size_t i = 0; i < num_limbs && ++limbs_[i] == 0; ++i) {
+		}
+		return *this;
+	}
+
+	constexpr FixedInteger& operator--() {
+		for (std::size_t i = 0; i < num_limbs && limbs_[i]-- == 0; ++i) {
+		}
+		return *this;
+	}
+
+	// Replace the value by 2^Bits minus the value (its two's complement).
+	constexpr void negate() {
+		for (std::size_t i = 0; i < num_limbs; ++i) {
+			limbs_[i] = ~limbs_[i];
+		}
+		++*this;
+	}
+
+	// Long division (Knuth's Algorithm D) of u by v: store u / v in q and
+	// u % v in r. q and r may be u or v.
+	// @throws std::domain_error if v is 0 (q and r are then left unchanged)
+	static constexpr void divmod(const FixedInteger& u, const FixedInteger& v,
+		FixedInteger& q, FixedInteger& r) {
+
+		// Check for division by 0!
+		std::size_t n = v.length();
+		if (n == 0) {
+			throw std::domain_error("FixedInteger division by 0");
+		}
+
+		FixedInteger quot;
+		FixedInteger rem;
+		std::size_t un = u.length();
+
+		if (un < n) {
+			rem = u;
+		}
+		else if (n == 1) {
+
+			// Dividing by a single word only needs one pass.
+			std::uint64_t carry = 0;
+			for (std::size_t i = un; i-- > 0; ) {
+				carry = (carry << 32) | u.limbs_[i];
+				quot.limbs_[i] = std::uint32_t(carry / v.limbs_[0]);
+				carry %= v.limbs_[0];
+			}
+			rem.limbs_[0] = std::uint32_t(carry);
+		}
+		else {
+
+			// Normalize so that the top bit of the divisor is set.
+			unsigned int s = 0;
+			for (std::uint32_t top = v.limbs_[n - 1]; !(top & 0x80000000u); top <<= 1) {
+				++s;
+			}
+
+			std::uint32_t un_words[num_limbs + 1] = {};
+			std::uint32_t vn_words[num_limbs] = {};
+			for (std::size_t i = un; i-- > 0; ) {
+				un_words[i + 1] |= (s == 0) ? 0 : u.limbs_[i] >> (32 - s);
+				un_words[i] = u.limbs_[i] << s;
+			}
+			for (std::size_t i = n; i-- > 0; ) {
+				vn_words[i] = (v.limbs_[i] << s)
+					| ((s == 0 || i == 0) ? 0 : v.limbs_[i - 1] >> (32 - s));
+			}
+
+			const std::uint64_t base = std::uint64_t(1) << 32;
+
+			for (std::size_t j = un - n + 1; j-- > 0; ) {
+				std::uint64_t num = (std::uint64_t(un_words[j + n]) << 32) | un_words[j + n - 1];
+				std::uint64_t qhat = num / vn_words[n - 1];
+				std::uint64_t rhat = num % vn_words[n - 1];
+
+				while (qhat >= base
+					|| qhat * vn_words[n - 2] > ((rhat << 32) | un_words[j + n - 2])) {
+					--qhat;
+					rhat += vn_words[n - 1];
+					if (rhat >= base) {
+						break;
+					}
+				}
+
+				// Multiply and subtract qhat * v from the current window.
+				std::int64_t k = 0;
+				std::int64_t t = 0;
+				for (std::size_t i = 0; i < n; ++i) {
+					std::uint64_t p = qhat * vn_words[i];
+					t = std::int64_t(un_words[i + j]) - k - std::int64_t(p & 0xFFFFFFFFu);
+					un_words[i + j] = std::uint32_t(t);
+					k = std::int64_t(p >> 32) - (t >> 32);
+				}
+				t = std::int64_t(un_words[j + n]) - k;
+				un_words[j + n] = std::uint32_t(t);
+
+				quot.limbs_[j] = std::uint32_t(qhat);
+
+				// qhat was one too large, so add v back.
+				if (t < 0) {
+					--quot.limbs_[j];
+					std::uint64_t carry = 0;
+					for (std::size_t i = 0; i < n; ++i) {
+						carry += std::uint64_t(un_words[i + j]) + vn_words[i];
+						un_words[i + j] = std::uint32_t(carry);
+						carry >>= 32;
+					}
+					un_words[j + n] += std::uint32_t(carry);
+				}
+			}
+
+			// Undo the normalization of the remainder.
+			for (std::size_t i = 0; i < n; ++i) {
+				rem.limbs_[i] = (s == 0) ? un_words[i]
+					: (un_words[i] >> s) | (un_words[i + 1] << (32 - s));
+			}
+		}
+
+		q = quot;
+		r = rem;
+	}
+
+private:
+	// The words of the value, least significant first.
+	std::uint32_t limbs_[num_limbs];
+};
+
+template <unsigned int Bits>
+constexpr std::size_t FixedInteger<Bits>::num_limbs;
+
+template <unsigned int Bits>
+constexpr FixedInteger<Bits> operator+(FixedInteger<Bits> lhs, const FixedInteger<Bits>& rhs) {
+	return lhs += rhs;
+}
+
+template <unsigned int Bits>
+constexpr FixedInteger<Bits> operator-(FixedInteger<Bits> lhs, const FixedInteger<Bits>& rhs) {
+	return lhs -= rhs;
+}
+
+template <unsigned int Bits>
+constexpr FixedInteger<Bits> operator*(FixedInteger<Bits> lhs, const FixedInteger<Bits>& rhs) {
+	return lhs *= rhs;
+}
+
+template <unsigned int Bits>
+constexpr FixedInteger<Bits> operator/(FixedInteger<Bits> lhs, const FixedInteger<Bits>& rhs) {
+	return lhs /= rhs;
+}
+
+template <unsigned int Bits>
+constexpr FixedInteger<Bits> operator%(FixedInteger<Bits> lhs, const FixedInteger<Bits>& rhs) {
+	return lhs %= rhs;
+}
+
+// Compare two FixedIntegers.
+// @return -1, 0 or 1 if lhs is less than, equal to or greater than rhs
+template <unsigned int Bits>
+constexpr int compare(const FixedInteger<Bits>& lhs, const FixedInteger<Bits>& rhs) {
+	for (std::size_t i = FixedInteger<Bits>::num_limbs; i-- > 0; ) {
+		if (lhs.limb(i) != rhs.limb(i)) {
+			return (lhs.limb(i) < rhs.limb(i)) ? -1 : 1;
+		}
+	}
+	return 0;
+}
+
+template <unsigned int Bits>
+constexpr bool operator==(const FixedInteger<Bits>& lhs, const FixedInteger<Bits>& rhs) {
+	return compare(lhs, rhs) == 0;
+}
+
+template <unsigned int Bits>
+constexpr bool operator!=(const FixedInteger<Bits>& lhs, const FixedInteger<Bits>& rhs) {
+	return compare(lhs, rhs) != 0;
+}
+
+template <unsigned int Bits>
+constexpr bool operator<(const FixedInteger<Bits>& lhs, const FixedInteger<Bits>& rhs) {
+	return compare(lhs, rhs) < 0;
+}
+
+template <unsigned int Bits>
+constexpr bool operator<=(const FixedInteger<Bits>& lhs, const FixedInteger<Bits>& rhs) {
+	return compare(lhs, rhs) <= 0;
+}
+
+template <unsigned int Bits>
+constexpr bool operator>(const FixedInteger<Bits>& lhs, const FixedInteger<Bits>& rhs) {
+	return compare(lhs, rhs) > 0;
+}
+
+template <unsigned int Bits>
+constexpr bool operator>=(const FixedInteger<Bits>& lhs, const FixedInteger<Bits>& rhs) {
+	return compare(lhs, rhs) >= 0;
+}
+
+// the output operator for FixedInteger
+// write the decimal value of val to stream
+template <unsigned int Bits>
+std::ostream& operator << (std::ostream& os, const FixedInteger<Bits>& val) {
+	os << val.decimal_string();
+	return os;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// @class FixedSignedInteger
+// @brief A signed fixed-width value, stored inline in two's complement.
+//
+// A FixedSignedInteger<Bits> holds a value between -2^(Bits - 1) and
+// 2^(Bits - 1) - 1 as a FixedInteger<Bits> in two's complement (as with
+// TwosComplementInteger), so + - * are the same word operations as for
+// FixedInteger and wrap around just like the signed machine types would if
+// they wrapped. / and % work on the magnitudes, as for SignedInteger:
+// division truncates toward zero and the remainder has the sign of the
+// dividend. Everything except the conversions to and from SignedInteger is
+// constexpr and never allocates:
+//   constexpr FixedSignedInteger<512> a(-7);
+//   constexpr FixedSignedInteger<512> b = a * a - FixedSignedInteger<512>(50); // -1
+////////////////////////////////////////////////////////////////////////////////
+
+template <unsigned int Bits>
+class FixedSignedInteger {
+public:
+	// Default constructor--default value is 0
+	constexpr FixedSignedInteger() : bits_() {}
+
+	// Construct the value val (mod 2^Bits)
+	constexpr FixedSignedInteger(std::int64_t val) : bits_(std::uint64_t(val)) {
+
+		// Sign-extend val past its 64 bits.
+		for (std::size_t i = 2; val < 0 && i < FixedInteger<Bits>::num_limbs; ++i) {
+			bits_.set_limb(i, 0xFFFFFFFFu);
+		}
+	}
+
+	// Construct the value val (mod 2^Bits)
+	explicit FixedSignedInteger(const SignedInteger& val)
+		: bits_(val.magnitude()) {
+		if (val.is_negative()) {
+			bits_.negate();
+		}
+	}
+
+	// Reinterpret the words of val as a two's complement value.
+	constexpr explicit FixedSignedInteger(const FixedInteger<Bits>& val) : bits_(val) {}
+
+	// Convert this value to a SignedInteger.
+	SignedInteger to_signed_integer() const {
+		FixedInteger<Bits> mag = magnitude();
+		return IntegerView(mag.limbs(), mag.length(), is_negative()).to_signed_integer();
+	}
+
+	// Return the words of the value in two's complement.
+	constexpr const FixedInteger<Bits>& bits() const { return bits_; }
+
+	// Return |value| (which, for -2^(Bits - 1), only fits unsigned).
+	constexpr FixedInteger<Bits> magnitude() const {
+		FixedInteger<Bits> mag = bits_;
+		if (is_negative()) {
+			mag.negate();
+		}
+		return mag;
+	}
+
+	constexpr bool is_negative() const { return bits_.get_bit(Bits - 1); }
+	constexpr bool is_zero() const { return bits_.is_zero(); }
+
+	std::string binary_string() const { return to_signed_integer().binary_string(); }
+	std::string decimal_string() const { return to_signed_integer().decimal_string(); }
+
+	constexpr void negate() { bits_.negate(); }
+
+	constexpr FixedSignedInteger& operator+=(const FixedSignedInteger& rhs) {
+		bits_ += rhs.bits_;
+		return *this;
+	}
+
+	constexpr FixedSignedInteger& operator-=(const FixedSignedInteger& rhs) {
+		bits_ -= rhs.bits_;
+		return *this;
+	}
+
+	constexpr FixedSignedInteger& operator*=(const FixedSignedInteger& rhs) {
+		bits_ *= rhs.bits_;
+		return *this;
+	}
+
+	constexpr FixedSignedInteger& operator/=(const FixedSignedInteger& rhs) {
+		bool neg = is_negative() != rhs.is_negative();
+		FixedInteger<Bits> quot = magnitude();
+		FixedInteger<Bits> rem;
+		FixedInteger<Bits>::divmod(quot, rhs.magnitude(), quot, rem);
+		bits_ = quot;
+		if (neg) {
+			bits_.negate();
+		}
+		return *this;
+	}
+
+	constexpr FixedSignedInteger& operator%=(const FixedSignedInteger& rhs) {
+		bool neg = is_negative();
+		FixedInteger<Bits> quot;
+		FixedInteger<Bits> rem = magnitude();
+		FixedInteger<Bits>::divmod(rem, rhs.magnitude(), quot, rem);
+		bits_ = rem;
+		if (neg) {
+			bits_.negate();
+		}
+		return *this;
+	}
+
+	constexpr FixedSignedInteger& operator++() {
+		++bits_;
+		return *this;
+	}
+
+	constexpr FixedSignedInteger& operator--() {
+		--bits_;
+		return *this;
+	}
+
+private:
+	// The value in two's complement.
+	FixedInteger<Bits> bits_;
+};
+
+template <unsigned int Bits>
+constexpr FixedSignedInteger<Bits> operator+(FixedSignedInteger<Bits> lhs,
+	const FixedSignedInteger<Bits>& rhs) {
+	return lhs += rhs;
+}
+
+template <unsigned int Bits>
+constexpr FixedSignedInteger<Bits> operator-(FixedSignedInteger<Bits> lhs,
+	const FixedSignedInteger<Bits>& rhs) {
+	return lhs -= rhs;
+}
+
+template <unsigned int Bits>
+constexpr FixedSignedInteger<Bits> operator*(FixedSignedInteger<Bits> lhs,
+	const FixedSignedInteger<Bits>& rhs) {
+	return lhs *= rhs;
+}
+
+template <unsigned int Bits>
+constexpr FixedSignedInteger<Bits> operator/(FixedSignedInteger<Bits> lhs,
+	const FixedSignedInteger<Bits>& rhs) {
+	return lhs /= rhs;
+}
+
+template <unsigned int Bits>
+constexpr FixedSignedInteger<Bits> operator%(FixedSignedInteger<Bits> lhs,
+	const FixedSignedInteger<Bits>& rhs) {
+	return lhs %= rhs;
+}
+
+template <unsigned int Bits>
+constexpr FixedSignedInteger<Bits> operator-(FixedSignedInteger<Bits> val) {
+	val.negate();
+	return val;
+}
+
+// Compare two FixedSignedIntegers.
+// @return -1, 0 or 1 if lhs is less than, equal to or greater than rhs
+template <unsigned int Bits>
+constexpr int compare(const FixedSignedInteger<Bits>& lhs, const FixedSignedInteger<Bits>& rhs) {
+	if (lhs.is_negative() != rhs.is_negative()) {
+		return lhs.is_negative() ? -1 : 1;
+	}
+
+	// Values of the same sign compare like their words.
+	return compare(lhs.bits(), rhs.bits());
+}
+
+template <unsigned int Bits>
+constexpr bool operator==(const FixedSignedInteger<Bits>& lhs, const FixedSignedInteger<Bits>& rhs) {
+	return compare(lhs, rhs) == 0;
+}
+
+template <unsigned int Bits>
+constexpr bool operator!=(const FixedSignedInteger<Bits>& lhs, const FixedSignedInteger<Bits>& rhs) {
+	return compare(lhs, rhs) != 0;
+}
+
+template <unsigned int Bits>
+constexpr bool operator<(const FixedSignedInteger<Bits>& lhs, const FixedSignedInteger<Bits>& rhs) {
+	return compare(lhs, rhs) < 0;
+}
+
+template <unsigned int Bits>
+constexpr bool operator<=(const FixedSignedInteger<Bits>& lhs, const FixedSignedInteger<Bits>& rhs) {
+	return compare(lhs, rhs) <= 0;
+}
+
+template <unsigned int Bits>
+constexpr bool operator>(const FixedSignedInteger<Bits>& lhs, const FixedSignedInteger<Bits>& rhs) {
+	return compare(lhs, rhs) > 0;
+}
+
+template <unsigned int Bits>
+constexpr bool operator>=(const FixedSignedInteger<Bits>& lhs, const FixedSignedInteger<Bits>& rhs) {
+	return compare(lhs, rhs) >= 0;
+}
+
+// the output operator for FixedSignedInteger
+// write the decimal value of val (with its sign) to stream
+template <unsigned int Bits>
+std::ostream& operator << (std::ostream& os, const FixedSignedInteger<Bits>& val) {
+	os << val.decimal_string();
+	return os;
+}
+
+#endif
+
+
+////////////////////////////////////////////////////////////////////////////////
+// @class IntegerExpression
+// @brief Deferred evaluation of sums, differences and products of Integers.
+//
+// The ordinary operators compute a full temporary Integer at every step, so
+// a + b + c - d makes three passes over the data. Wrapping the first operand
+// in lazy() makes the operators build an expression instead, which evaluate()
+// then computes in as few passes as possible:
+//   SignedInteger r = evaluate(lazy(a) + b + c - d);
+//   SignedInteger s = evaluate(lazy(a) * b + lazy(c) * d - e);
+// The expression is flattened into terms of the form +-x and +-x * y. All the
+// terms +-x are added up in a single carry pass, and each product is added
+// into the result with multiply-accumulate steps rather than being stored
+// first (very large products use Karatsuba's method and are then added).
+// A factor which is not a single value, as in (lazy(a) + b) * c, is
+// evaluated on its own first. SignedInteger operands keep their signs. Note
+// that every product needs its own lazy(): in lazy(a) + c * d, the product
+// c * d is computed by the ordinary operator before the expression sees it.
+//
+// An expression refers to its operands instead of copying them, so it must
+// be evaluated while they are all still alive and unchanged (typically in
+// the same statement).
+////////////////////////////////////////////////////////////////////////////////
+
+// One term of a flattened expression: lhs, or lhs * rhs if rhs is not null,
+// negated if negative is true. Only the magnitudes of lhs and rhs are used.
+struct IntegerTerm {
+	const Integer* lhs;
+	const Integer* rhs;
+	bool negative;
+};
+
+// Compute the sum of a list of terms.
+// @param terms the terms to be added
+// @return the sum of terms
+SignedInteger evaluate_terms(const std::vector<IntegerTerm>& terms);
+
+template <typename E>
+class IntegerExpression {
+public:
+	inline const E& self() const { return static_cast<const E&>(*this); }
+
+	// Evaluate this expression on its own, for use as the factor of a
+	// product. The value is stored in temps, which outlives the terms.
+	// @param negative set to true if the value is negative
+	// @return a pointer to the value
+	const Integer* factor(std::deque<SignedInteger>& temps, bool& negative) const {
+		std::vector<IntegerTerm> terms;
+		self().collect(terms, temps, false);
+		temps.push_back(evaluate_terms(terms));
+		negative = temps.back().is_negative();
+		return &temps.back().magnitude();
+	}
+};
+
+// A single Integer (or SignedInteger) operand.
+class IntegerRef : public IntegerExpression<IntegerRef> {
+public:
+	// Refer to val (a SignedInteger keeps its sign).
+	explicit IntegerRef(const Integer& val);
+	explicit IntegerRef(const SignedInteger& val);
+
+	// Append the term val (or -val, if negate is true) to terms.
+	void collect(std::vector<IntegerTerm>& terms, std::deque<SignedInteger>& temps,
+		bool negate) const;
+
+	// A single value is its own factor; nothing needs evaluating.
+	const Integer* factor(std::deque<SignedInteger>& temps, bool& negative) const;
+
+private:
+	const Integer* val_;
+	bool neg_;
+};
+
+// lhs + rhs, or lhs - rhs if subtract is true.
+template <typename L, typename R>
+class IntegerSum : public IntegerExpression<IntegerSum<L, R> > {
+public:
+	IntegerSum(const L& lhs, const R& rhs, bool subtract)
+		: lhs_(lhs), rhs_(rhs), subtract_(subtract) {}
+
+	void collect(std::vector<IntegerTerm>& terms, std::deque<SignedInteger>& temps,
+		bool negate) const {
+		lhs_.collect(terms, temps, negate);
+		rhs_.collect(terms, temps, negate != subtract_);
+	}
+
+private:
+	L lhs_;
+	R rhs_;
+	bool subtract_;
+};
+
+// lhs * rhs
+template <typename L, typename R>
+class IntegerProduct : public IntegerExpression<IntegerProduct<L, R> > {
+public:
+	IntegerProduct(const L& lhs, const R& rhs) : lhs_(lhs), rhs_(rhs) {}
+
+	void collect(std::vector<IntegerTerm>& terms, std::deque<SignedInteger>& temps,
+		bool negate) const {
+		bool lhs_negative, rhs_negative;
+		const Integer* lhs = lhs_.factor(temps, lhs_negative);
+		const Integer* rhs = rhs_.factor(temps, rhs_negative);
+
+		IntegerTerm term = { lhs, rhs, (lhs_negative != rhs_negative) != negate };
+		terms.push_back(term);
+	}
+
+private:
+	L lhs_;
+	R rhs_;
+};
+
+// Start an expression with the operand val.
+inline IntegerRef lazy(const Integer& val) { return IntegerRef(val); }
+inline IntegerRef lazy(const SignedInteger& val) { return IntegerRef(val); }
+
+// Compute the value of an expression.
+// @param expr the expression, built from lazy() and the operators below
+// @return the value of expr
+template <typename E>
+SignedInteger evaluate(const IntegerExpression<E>& expr) {
+	std::vector<IntegerTerm> terms;
+	std::deque<SignedInteger> temps;
+	expr.self().collect(terms, temps, false);
+	return evaluate_terms(terms);
+}
+
+// The operators below accept an Integer or a SignedInteger as either
+// operand; the operand's own type picks the IntegerRef constructor, so a
+// SignedInteger keeps its sign.
+template <typename T, typename Result>
+struct IntegerOperand : std::enable_if<std::is_same<T, Integer>::value ||
+	std::is_same<T, SignedInteger>::value, Result> {};
+
+template <typename L, typename R>
+IntegerSum<L, R> operator+(const IntegerExpression<L>& lhs, const IntegerExpression<R>& rhs) {
+	return IntegerSum<L, R>(lhs.self(), rhs.self(), false);
+}
+
+template <typename L, typename T>
+typename IntegerOperand<T, IntegerSum<L, IntegerRef> >::type
+operator+(const IntegerExpression<L>& lhs, const T& rhs) {
+	return IntegerSum<L, IntegerRef>(lhs.self(), IntegerRef(rhs), false);
+}
+
+template <typename T, typename R>
+typename IntegerOperand<T, IntegerSum<IntegerRef, R> >::type
+operator+(const T& lhs, const IntegerExpression<R>& rhs) {
+	return IntegerSum<IntegerRef, R>(IntegerRef(lhs), rhs.self(), false);
+}
+
+template <typename L, typename R>
+IntegerSum<L, R> operator-(const IntegerExpression<L>& lhs, const IntegerExpression<R>& rhs) {
+	return IntegerSum<L, R>(lhs.self(), rhs.self(), true);
+}
+
+template <typename L, typename T>
+typename IntegerOperand<T, IntegerSum<L, IntegerRef> >::type
+operator-(const IntegerExpression<L>& lhs, const T& rhs) {
+	return IntegerSum<L, IntegerRef>(lhs.self(), IntegerRef(rhs), true);
+}
+
+template <typename T, typename R>
+typename IntegerOperand<T, IntegerSum<IntegerRef, R> >::type
+operator-(const T& lhs, const IntegerExpression<R>& rhs) {
+	return IntegerSum<IntegerRef, R>(IntegerRef(lhs), rhs.self(), true);
+}
+
+template <typename L, typename R>
+IntegerProduct<L, R> operator*(const IntegerExpression<L>& lhs, const IntegerExpression<R>& rhs) {
+	return IntegerProduct<L, R>(lhs.self(), rhs.self());
+}
+
+template <typename L, typename T>
+typename IntegerOperand<T, IntegerProduct<L, IntegerRef> >::type
+operator*(const IntegerExpression<L>& lhs, const T& rhs) {
+	return IntegerProduct<L, IntegerRef>(lhs.self(), IntegerRef(rhs));
+}
+
+template <typename T, typename R>
+typename IntegerOperand<T, IntegerProduct<IntegerRef, R> >::type
+operator*(const T& lhs, const IntegerExpression<R>& rhs) {
+	return IntegerProduct<IntegerRef, R>(IntegerRef(lhs), rhs.self());
+}
+
+
 #endif
 